@@ -0,0 +1,250 @@
+#include "access_log.hpp"
+#include "metrics.hpp"
+#include "spsc_ring.hpp"
+#include <boost/beast/http/verb.hpp>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace access_log {
+
+std::atomic<bool> is_open{false};
+
+namespace {
+
+struct thread_ring
+{
+    spsc_ring<entry, 4096> ring;
+    std::atomic<bool> closed{false};
+};
+
+class writer
+{
+    static constexpr std::size_t segment_size = 16 * 1024;
+    static constexpr std::size_t max_segments = 64;
+
+    int fd_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::shared_ptr<thread_ring>> rings_;
+    bool stop_ = false;
+
+    // Formatted lines waiting for the next writev, one iovec each
+    std::vector<std::string> segments_;
+    std::size_t used_ = 0;
+    std::thread thread_;
+
+    std::string&
+    segment_for(std::size_t n)
+    {
+        if(used_ == 0 || segments_[used_ - 1].size() + n > segment_size)
+        {
+            if(used_ == max_segments)
+                write_segments();
+            if(used_ == segments_.size())
+                segments_.emplace_back().reserve(segment_size);
+            ++used_;
+        }
+        return segments_[used_ - 1];
+    }
+
+    void
+    format(entry const& e)
+    {
+        auto const seconds = static_cast<std::time_t>(e.time_ns / 1000000000);
+        std::tm tm{};
+        gmtime_r(&seconds, &tm);
+
+        char line[512];
+        auto n = std::strftime(line, sizeof(line), "%Y-%m-%dT%H:%M:%S", &tm);
+        auto const method = boost::beast::http::to_string(
+            static_cast<boost::beast::http::verb>(e.method));
+        n += static_cast<std::size_t>(std::snprintf(line + n, sizeof(line) - n,
+            ".%03dZ %llu %s %.*s %.*s %u %llu %u\n",
+            static_cast<int>(e.time_ns / 1000000 % 1000),
+            static_cast<unsigned long long>(e.session_id),
+            e.tls ? "tls" : "plain",
+            static_cast<int>(method.size()), method.data(),
+            static_cast<int>(e.target_size), e.target,
+            static_cast<unsigned>(e.status),
+            static_cast<unsigned long long>(e.bytes),
+            static_cast<unsigned>(e.latency_us)));
+        n = std::min(n, sizeof(line) - 1);
+        segment_for(n).append(line, n);
+    }
+
+    void
+    write_segments()
+    {
+        std::array<iovec, max_segments> iov;
+        std::size_t count = 0;
+        for(std::size_t i = 0; i < used_; ++i)
+            iov[count++] = {segments_[i].data(), segments_[i].size()};
+
+        // Keep going after short writes until everything is out
+        std::size_t first = 0;
+        while(first < count)
+        {
+            auto const n = ::writev(fd_, &iov[first], static_cast<int>(count - first));
+            if(n < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                break;
+            }
+            auto left = static_cast<std::size_t>(n);
+            while(first < count && left >= iov[first].iov_len)
+                left -= iov[first++].iov_len;
+            if(first < count)
+            {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + left;
+                iov[first].iov_len -= left;
+            }
+        }
+
+        for(std::size_t i = 0; i < used_; ++i)
+            segments_[i].clear();
+        used_ = 0;
+    }
+
+    std::size_t
+    drain()
+    {
+        std::vector<std::shared_ptr<thread_ring>> rings;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            rings = rings_;
+        }
+
+        std::size_t n = 0;
+        for(auto const& r : rings)
+            n += r->ring.drain([this](entry const& e) { format(e); });
+        if(used_ > 0)
+            write_segments();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.erase(
+            std::remove_if(rings_.begin(), rings_.end(),
+                [](std::shared_ptr<thread_ring> const& r)
+                {
+                    return r->closed.load(std::memory_order_acquire) && r->ring.empty();
+                }),
+            rings_.end());
+        return n;
+    }
+
+    void
+    run()
+    {
+        auto idle = std::chrono::milliseconds(1);
+        for(;;)
+        {
+            if(drain() > 0)
+            {
+                idle = std::chrono::milliseconds(1);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(stop_)
+                break;
+            cv_.wait_for(lock, idle);
+            idle = std::min(idle * 2, std::chrono::milliseconds(10));
+        }
+        drain();
+    }
+
+public:
+    explicit
+    writer(int fd)
+        : fd_(fd)
+        , thread_([this] { run(); })
+    {
+    }
+
+    ~writer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+        ::close(fd_);
+    }
+
+    std::shared_ptr<thread_ring>
+    add_ring()
+    {
+        auto r = std::make_shared<thread_ring>();
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(r);
+        return r;
+    }
+};
+
+std::unique_ptr<writer>&
+get_writer()
+{
+    static std::unique_ptr<writer> w;
+    return w;
+}
+
+struct ring_handle
+{
+    std::shared_ptr<thread_ring> ring = get_writer()->add_ring();
+
+    ~ring_handle()
+    {
+        ring->closed.store(true, std::memory_order_release);
+    }
+};
+
+} // namespace
+
+void
+open(std::string const& path, boost::beast::error_code& ec)
+{
+    auto const fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        ec.assign(errno, boost::beast::system_category());
+        return;
+    }
+    get_writer() = std::make_unique<writer>(fd);
+    is_open.store(true, std::memory_order_release);
+    ec = {};
+}
+
+void
+push(entry const& e) noexcept
+{
+    thread_local ring_handle handle;
+    auto const pushed = handle.ring->ring.try_push(
+        [&e](entry& slot)
+        {
+            std::memcpy(&slot, &e, offsetof(entry, target) + e.target_size);
+        });
+    if(! pushed)
+        metrics::add(metrics::counter::access_log_dropped);
+}
+
+void
+close()
+{
+    is_open.store(false, std::memory_order_release);
+    get_writer().reset();
+}
+
+} // access_log
@@ -0,0 +1,71 @@
+#ifndef IR_WEBSOCKET_SERVER_ACCESS_LOG_HPP
+#define IR_WEBSOCKET_SERVER_ACCESS_LOG_HPP
+
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/string.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Per-request access log.
+//
+// Sessions copy a fixed-size binary entry into a per-thread ring and
+// move on. A background thread formats the entries and appends them
+// to the log file with batched writev calls. If a ring is full the
+// entry is dropped and counted in the metrics, the io thread never
+// waits for the disk.
+namespace access_log {
+
+struct entry
+{
+    std::int64_t time_ns;       // system clock, when the response was written
+    std::uint64_t session_id;
+    std::uint64_t bytes;
+    std::uint32_t latency_us;   // request parsed until response written
+    std::uint16_t status;
+    std::uint8_t method;        // http::verb
+    bool tls;
+    std::uint16_t target_size;
+    char target[222];
+
+    void
+    set_target(boost::beast::string_view target) noexcept
+    {
+        target_size = static_cast<std::uint16_t>(
+            std::min<std::size_t>(target.size(), sizeof(this->target)));
+        std::memcpy(this->target, target.data(), target_size);
+    }
+};
+
+static_assert(sizeof(entry) == 256, "keep entries to four cache lines");
+
+extern std::atomic<bool> is_open;
+
+inline bool
+enabled() noexcept
+{
+    return is_open.load(std::memory_order_relaxed);
+}
+
+// Open the log for appending and start the writer thread
+void open(std::string const& path, boost::beast::error_code& ec);
+
+// Queue an entry, or drop it if the calling thread's ring is full
+void push(entry const& e) noexcept;
+
+// Write every queued entry and stop the writer thread
+void close();
+
+// Return a process-wide unique session id
+inline std::uint64_t
+next_session_id() noexcept
+{
+    static std::atomic<std::uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // access_log
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef IR_WEBSOCKET_SERVER_ACCESS_TOKEN_HPP
+#define IR_WEBSOCKET_SERVER_ACCESS_TOKEN_HPP
+
+#include "include/jwt-cpp/traits/boost-json/defaults.h"
+#include "metrics.hpp"
+#include "query_string.hpp"
+#include "shared_state.hpp"
+#include <exception>
+#include <string>
+
+// The token a request carries, from "Authorization: Bearer" or else
+// the "token" query parameter, which is all a browser's WebSocket
+// or EventSource can send
+inline std::string
+request_token(boost::beast::string_view target, boost::beast::string_view authorization)
+{
+    boost::beast::string_view const bearer = "Bearer ";
+    if (authorization.size() > bearer.size() &&
+        boost::beast::iequals(authorization.substr(0, bearer.size()), bearer))
+        return std::string(authorization.substr(bearer.size()));
+
+    std::string token;
+    if (auto const encoded = query_string(target).find("token"))
+    {
+        // jwt::decode takes a std::string, so decode straight into it
+        token.resize(encoded->size());
+        token.resize(query_string::decode(*encoded, &token[0]));
+    }
+    return token;
+}
+
+// Check a token issued by /api/ws: its signature, issuer, audience and
+// expiry, then whether it has been revoked. Returns false and the
+// reason if the token is not accepted.
+inline bool
+verify_access_token(shared_state const &state, std::string const &token, std::string &error)
+{
+    try
+    {
+        auto const decoded = jwt::decode<jwt::traits::boost_json>(token);
+        auto const verify = jwt::verify<jwt::traits::boost_json>()
+            .allow_algorithm(jwt::algorithm::hs256{"secret"})
+            .with_issuer("auth0")
+            .with_audience("aud0");
+        verify.verify(decoded);
+
+        // Revocation is checked after the signature so that
+        // forged tokens never reach the revocation set
+        if (decoded.has_id() && state.is_revoked(decoded.get_id()))
+        {
+            metrics::add(metrics::counter::jwt_revoked);
+            error = "token revoked";
+            return false;
+        }
+    }
+    catch (std::exception const &e)
+    {
+        metrics::add(metrics::counter::jwt_failed);
+        error = e.what();
+        return false;
+    }
+    metrics::add(metrics::counter::jwt_verified);
+    return true;
+}
+
+#endif
@@ -1,14 +1,27 @@
 #include "common/server_certificate.hpp"
+#include "file_watcher.hpp"
 #include "listener.hpp"  // Include the listener header file
 #include "shared_state.hpp"
 
 int main(int argc, char* argv[])
 {
     // Check command line arguments.
-    if (argc != 5)
+    if (argc < 5)
     {
         std::cerr <<
-            "Usage: advanced-server-flex <address> <port> <doc_root> <threads>\n" <<
+            "Usage: advanced-server-flex <address> <port> <doc_root> <threads> [options]\n" <<
+            "Options:\n" <<
+            "    --revoked-jti=<file>    revoked token ids, one per line (reloaded on SIGHUP)\n" <<
+            "    --mime-types=<file>     extra mime types in mime.types format\n" <<
+            "    --dump-histograms       print latency percentiles at shutdown\n" <<
+            "    --log-level=<level>     trace, debug, info (default), warn, error or off\n" <<
+            "    --access-log=<file>     append one line per response to the file\n" <<
+            "    --pipeline-depth=<n>    most pipelined responses queued per connection (1-32, default 16)\n" <<
+            "    --pipeline-bytes=<n>    stop reading while more response bytes are queued (default 1048576)\n" <<
+            "    --cache-ttl=<ms>        stat() cached files again after this long (default 1000, 60000 while watching)\n" <<
+            "    --no-watch              do not watch doc_root for changes with inotify\n" <<
+            "    --mmap-max=<n>          send files up to this size from shared mappings, only safe if files are replaced by rename (default 0, off)\n" <<
+            "    --upload-dir=<dir>      accept PUT /uploads/<name> into this directory\n" <<
             "Example:\n" <<
             "    advanced-server-flex 0.0.0.0 8080 . 1\n";
         return EXIT_FAILURE;
@@ -18,6 +31,145 @@ int main(int argc, char* argv[])
     auto const doc_root = argv[3];
     auto const threads = std::max<int>(1, std::atoi(argv[4]));
 
+    auto const state = std::make_shared<shared_state>(doc_root);
+    bool dump_histograms = false;
+    bool watch_files = true;
+    boost::optional<std::chrono::milliseconds> cache_ttl;
+
+    for (int i = 5; i < argc; ++i)
+    {
+        beast::string_view const arg = argv[i];
+        beast::string_view const revoked_jti = "--revoked-jti=";
+        if (arg.starts_with(revoked_jti))
+        {
+            // Running without the list would accept every revoked token
+            if (!state->set_revocation_file(std::string(arg.substr(revoked_jti.size()))))
+            {
+                std::cerr << "Cannot load revoked token ids: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        if (arg == "--dump-histograms")
+        {
+            dump_histograms = true;
+            continue;
+        }
+        beast::string_view const log_level = "--log-level=";
+        if (arg.starts_with(log_level))
+        {
+            logging::level level;
+            if (!logging::parse_level(argv[i] + log_level.size(), level))
+            {
+                std::cerr << "Unknown log level: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+            logging::set_level(level);
+            continue;
+        }
+        beast::string_view const access_log_file = "--access-log=";
+        if (arg.starts_with(access_log_file))
+        {
+            beast::error_code ec;
+            access_log::open(std::string(arg.substr(access_log_file.size())), ec);
+            if (ec)
+            {
+                std::cerr << "access log: " << ec.message() << "\n";
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        beast::string_view const pipeline_depth = "--pipeline-depth=";
+        if (arg.starts_with(pipeline_depth))
+        {
+            auto const depth = std::atoi(argv[i] + pipeline_depth.size());
+            if (depth < 1 || depth > 32)
+            {
+                std::cerr << "Pipeline depth must be between 1 and 32: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+            state->set_pipeline_depth(static_cast<std::size_t>(depth));
+            continue;
+        }
+        beast::string_view const pipeline_bytes = "--pipeline-bytes=";
+        if (arg.starts_with(pipeline_bytes))
+        {
+            auto const bytes = std::atoll(argv[i] + pipeline_bytes.size());
+            if (bytes < 1)
+            {
+                std::cerr << "Pipeline bytes must be positive: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+            state->set_pipeline_bytes(static_cast<std::uint64_t>(bytes));
+            continue;
+        }
+        beast::string_view const cache_ttl_ms = "--cache-ttl=";
+        if (arg.starts_with(cache_ttl_ms))
+        {
+            auto const ms = std::atoll(argv[i] + cache_ttl_ms.size());
+            if (ms < 0)
+            {
+                std::cerr << "Cache ttl must not be negative: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+            cache_ttl = std::chrono::milliseconds(ms);
+            continue;
+        }
+        beast::string_view const mmap_max = "--mmap-max=";
+        if (arg.starts_with(mmap_max))
+        {
+            auto const size = std::atoll(argv[i] + mmap_max.size());
+            if (size < 0)
+            {
+                std::cerr << "Mapping size must not be negative: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+            state->mappings().set_max_size(static_cast<std::uint64_t>(size));
+            continue;
+        }
+        beast::string_view const upload_dir = "--upload-dir=";
+        if (arg.starts_with(upload_dir))
+        {
+            state->set_upload_dir(std::string(arg.substr(upload_dir.size())));
+            continue;
+        }
+        if (arg == "--no-watch")
+        {
+            watch_files = false;
+            continue;
+        }
+        beast::string_view const mime_types = "--mime-types=";
+        if (arg.starts_with(mime_types))
+        {
+            beast::error_code ec;
+            load_mime_types(std::string(arg.substr(mime_types.size())), ec);
+            if (ec)
+            {
+                std::cerr << "mime types: " << ec.message() << "\n";
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        std::cerr << "Unknown option: " << arg << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // Watch doc_root so that cached file metadata needs a stat() only
+    // now and then, falling back to the short ttl if that fails
+    file_watcher watcher(*state);
+    if (watch_files)
+    {
+        beast::error_code ec;
+        watcher.start(ec);
+        if (ec)
+            FLEX_LOG(warn, "file watcher: %s: %s, revalidating cached files by ttl",
+                doc_root, ec.message().c_str());
+        else
+            state->files().set_ttl(std::chrono::seconds(60));
+    }
+    if (cache_ttl)
+        state->files().set_ttl(*cache_ttl);
+
     // The io_context is required for all I/O
     net::io_context ioc{threads};
 
@@ -31,7 +183,7 @@ int main(int argc, char* argv[])
         ioc,
         ctx,
         tcp::endpoint{address, port},
-        std::make_shared<shared_state>(doc_root))->run();
+        state)->run();
 
     // Capture SIGINT and SIGTERM to perform a clean shutdown
     net::signal_set signals(ioc, SIGINT, SIGTERM);
@@ -44,6 +196,32 @@ int main(int argc, char* argv[])
             ioc.stop();
         });
 
+    // Capture SIGHUP to reload the revoked token ids
+    net::signal_set reload(ioc, SIGHUP);
+    std::function<void(beast::error_code const&, int)> on_reload =
+        [&](beast::error_code const& ec, int)
+        {
+            if (ec)
+                return;
+            state->reload_revocations();
+            reload.async_wait(on_reload);
+        };
+    reload.async_wait(on_reload);
+
+    // Keep idle event streams open and find the clients which left
+    net::steady_timer heartbeat(ioc);
+    std::function<void(beast::error_code const&)> on_heartbeat =
+        [&](beast::error_code const& ec)
+        {
+            if (ec)
+                return;
+            state->broadcasts().heartbeat();
+            heartbeat.expires_after(broadcast_hub::heartbeat_interval);
+            heartbeat.async_wait(on_heartbeat);
+        };
+    heartbeat.expires_after(broadcast_hub::heartbeat_interval);
+    heartbeat.async_wait(on_heartbeat);
+
     // Run the I/O service on the requested number of threads
     std::vector<std::thread> v;
     v.reserve(threads - 1);
@@ -61,5 +239,12 @@ int main(int argc, char* argv[])
     for(auto& t : v)
         t.join();
 
+    watcher.stop();
+    access_log::close();
+    logging::flush();
+
+    if (dump_histograms)
+        std::cerr << metrics::latency_summary();
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,144 @@
+#ifndef IR_WEBSOCKET_SERVER_ARENA_HPP
+#define IR_WEBSOCKET_SERVER_ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// A monotonic arena. Allocation bumps a pointer through a chain
+// of blocks and deallocation does nothing. reset() rewinds to the
+// first block but keeps them all, so once the arena has grown to
+// fit the largest request on a connection it stops allocating.
+//
+// Nothing allocated from the arena may be used after reset().
+class monotonic_arena
+{
+    struct block
+    {
+        std::unique_ptr<unsigned char[]> data;
+        std::size_t size;
+    };
+
+    std::vector<block> blocks_;
+    std::size_t current_ = 0;
+    std::size_t used_ = 0;
+    std::size_t block_size_;
+
+public:
+    explicit
+    monotonic_arena(std::size_t block_size = 4096)
+        : block_size_(block_size)
+    {
+    }
+
+    monotonic_arena(monotonic_arena const&) = delete;
+    monotonic_arena& operator=(monotonic_arena const&) = delete;
+
+    void*
+    allocate(std::size_t n, std::size_t align)
+    {
+        for(; current_ < blocks_.size(); ++current_, used_ = 0)
+        {
+            auto& b = blocks_[current_];
+            auto const base = reinterpret_cast<std::uintptr_t>(b.data.get());
+            auto const offset = ((base + used_ + align - 1) & ~(align - 1)) - base;
+            if(offset + n <= b.size)
+            {
+                used_ = offset + n;
+                return b.data.get() + offset;
+            }
+        }
+
+        // Out of blocks, grow by at least the requested size
+        auto const size = std::max(block_size_, n + align);
+        blocks_.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+        current_ = blocks_.size() - 1;
+        used_ = 0;
+        return allocate(n, align);
+    }
+
+    // Rewind to the first block, keeping every block for reuse
+    void
+    reset() noexcept
+    {
+        current_ = 0;
+        used_ = 0;
+    }
+
+    // Total bytes reserved by the arena
+    std::size_t
+    capacity() const noexcept
+    {
+        std::size_t n = 0;
+        for(auto const& b : blocks_)
+            n += b.size;
+        return n;
+    }
+};
+
+// A standard allocator which draws from a monotonic_arena
+template<class T>
+class arena_allocator
+{
+    template<class U>
+    friend class arena_allocator;
+
+    monotonic_arena* arena_;
+
+public:
+    using value_type = T;
+    using is_always_equal = std::false_type;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template<class U>
+    struct rebind
+    {
+        using other = arena_allocator<U>;
+    };
+
+    explicit
+    arena_allocator(monotonic_arena& arena) noexcept
+        : arena_(&arena)
+    {
+    }
+
+    template<class U>
+    arena_allocator(arena_allocator<U> const& other) noexcept
+        : arena_(other.arena_)
+    {
+    }
+
+    T*
+    allocate(std::size_t n)
+    {
+        if(n > static_cast<std::size_t>(-1) / sizeof(T))
+            throw std::bad_array_new_length();
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void
+    deallocate(T*, std::size_t) noexcept
+    {
+    }
+
+    template<class U>
+    friend bool
+    operator==(arena_allocator const& lhs, arena_allocator<U> const& rhs) noexcept
+    {
+        return lhs.arena_ == rhs.arena_;
+    }
+
+    template<class U>
+    friend bool
+    operator!=(arena_allocator const& lhs, arena_allocator<U> const& rhs) noexcept
+    {
+        return lhs.arena_ != rhs.arena_;
+    }
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef IR_WEBSOCKET_SERVER_BENCH_BENCH_HPP
+#define IR_WEBSOCKET_SERVER_BENCH_BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A minimal benchmark harness. Iteration counts and inputs are
+// fixed so that runs are comparable, and every suite prints one
+// JSON document on stdout for scripts to diff against a baseline.
+namespace bench {
+
+// Keep the optimizer from discarding a computed value
+template<class T>
+inline void
+do_not_optimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Summarize per-operation latencies as extra result fields, in microseconds
+inline std::vector<std::pair<std::string, double>>
+percentiles(std::vector<std::chrono::nanoseconds> samples)
+{
+    if(samples.empty())
+        return {};
+    std::sort(samples.begin(), samples.end());
+    auto const at = [&](double q)
+    {
+        auto const i = static_cast<std::size_t>(q * static_cast<double>(samples.size() - 1));
+        return static_cast<double>(samples[i].count()) / 1000.0;
+    };
+    return {
+        {"p50_us", at(0.50)},
+        {"p90_us", at(0.90)},
+        {"p99_us", at(0.99)},
+        {"max_us", at(1.00)}};
+}
+
+// Operations per second for `iterations` operations in `elapsed`
+inline double
+per_second(std::uint64_t iterations, std::chrono::nanoseconds elapsed)
+{
+    return static_cast<double>(iterations) * 1e9 /
+        static_cast<double>(elapsed.count());
+}
+
+class reporter
+{
+    struct result
+    {
+        std::string name;
+        std::uint64_t iterations;
+        double ns_per_op;
+        std::vector<std::pair<std::string, double>> extra;
+    };
+
+    std::string suite_;
+    std::vector<result> results_;
+
+public:
+    explicit
+    reporter(std::string suite)
+        : suite_(std::move(suite))
+    {
+    }
+
+    ~reporter()
+    {
+        std::printf("{\"suite\":\"%s\",\"results\":[", suite_.c_str());
+        for(std::size_t i = 0; i < results_.size(); ++i)
+        {
+            auto const& r = results_[i];
+            std::printf("%s\n  {\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.3f",
+                i ? "," : "",
+                r.name.c_str(),
+                static_cast<unsigned long long>(r.iterations),
+                r.ns_per_op);
+            for(auto const& e : r.extra)
+                std::printf(",\"%s\":%.3f", e.first.c_str(), e.second);
+            std::printf("}");
+        }
+        std::printf("\n]}\n");
+    }
+
+    void
+    add(std::string name,
+        std::uint64_t iterations,
+        std::chrono::nanoseconds elapsed,
+        std::vector<std::pair<std::string, double>> extra = {})
+    {
+        results_.push_back({
+            std::move(name),
+            iterations,
+            static_cast<double>(elapsed.count()) / static_cast<double>(iterations),
+            std::move(extra)});
+    }
+
+    // Time `iterations` calls of `f` after a short warm-up
+    template<class F>
+    void
+    run(std::string name, std::uint64_t iterations, F&& f)
+    {
+        for(std::uint64_t i = 0; i < iterations / 10; ++i)
+            f();
+        auto const start = std::chrono::steady_clock::now();
+        for(std::uint64_t i = 0; i < iterations; ++i)
+            f();
+        add(std::move(name), iterations,
+            std::chrono::steady_clock::now() - start);
+    }
+};
+
+} // bench
+
+#endif
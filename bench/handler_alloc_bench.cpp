@@ -0,0 +1,163 @@
+#include "../handler_allocator.hpp"
+#include "bench.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+
+namespace net = boost::asio;
+
+namespace {
+
+std::atomic<std::uint64_t> allocations{0};
+
+// One request/response exchange per iteration over a socket pair,
+// mirroring the read and write loops of a session
+template<bool Recycle>
+class exchange : public std::enable_shared_from_this<exchange<Recycle>>
+{
+    net::local::stream_protocol::socket client_;
+    net::local::stream_protocol::socket server_;
+    std::array<char, 128> request_{};
+    std::array<char, 128> received_{};
+    handler_memory read_memory_;
+    handler_memory write_memory_;
+    std::uint64_t remaining_;
+
+    template<class Handler>
+    auto
+    wrap(handler_memory& memory, Handler&& handler)
+    {
+        if constexpr(Recycle)
+            return make_custom_alloc_handler(memory, std::forward<Handler>(handler));
+        else
+            return std::forward<Handler>(handler);
+    }
+
+public:
+    exchange(net::io_context& ioc, std::uint64_t iterations)
+        : client_(ioc)
+        , server_(ioc)
+        , remaining_(iterations)
+    {
+        net::local::connect_pair(client_, server_);
+    }
+
+    void
+    run()
+    {
+        do_write();
+        do_read();
+    }
+
+    void
+    do_write()
+    {
+        net::async_write(
+            client_,
+            net::buffer(request_),
+            wrap(write_memory_, boost::beast::bind_front_handler(
+                &exchange::on_write, this->shared_from_this())));
+    }
+
+    void
+    on_write(boost::system::error_code ec, std::size_t)
+    {
+        if(ec)
+            std::abort();
+    }
+
+    void
+    do_read()
+    {
+        net::async_read(
+            server_,
+            net::buffer(received_),
+            wrap(read_memory_, boost::beast::bind_front_handler(
+                &exchange::on_read, this->shared_from_this())));
+    }
+
+    void
+    on_read(boost::system::error_code ec, std::size_t)
+    {
+        if(ec)
+            std::abort();
+        if(--remaining_ == 0)
+            return;
+        do_write();
+        do_read();
+    }
+};
+
+template<bool Recycle>
+void
+measure(bench::reporter& report, char const* name, std::uint64_t iterations)
+{
+    net::io_context ioc{1};
+    std::make_shared<exchange<Recycle>>(ioc, iterations)->run();
+    auto const before = allocations.load();
+    auto const start = std::chrono::steady_clock::now();
+    ioc.run();
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    auto const count = allocations.load() - before;
+    report.add(name, iterations, elapsed, {
+        {"allocations_per_request",
+            static_cast<double>(count) / static_cast<double>(iterations)}});
+}
+
+} // namespace
+
+// Every allocation is counted. The array forms are replaced as well,
+// and none is inlined, so that GCC never pairs a free() it can see
+// with an operator new it cannot and warns of a mismatch.
+__attribute__((noinline)) void*
+operator new(std::size_t size)
+{
+    ++allocations;
+    if(auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void*
+operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+__attribute__((noinline)) void
+operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void
+operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void
+operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+
+__attribute__((noinline)) void
+operator delete[](void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+int main()
+{
+    bench::reporter report("handler_allocator");
+    std::uint64_t constexpr iterations = 200000;
+    measure<false>(report, "default_allocator", iterations);
+    measure<true>(report, "recycling_allocator", iterations);
+}
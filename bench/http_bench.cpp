@@ -0,0 +1,244 @@
+#include "../request_handler.hpp"
+#include "../arena.hpp"
+#include "bench.hpp"
+#include <boost/optional.hpp>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <string>
+#include <tuple>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// An in-process load generator for the request path. Requests are
+// parsed from memory the way a session parses them off the wire,
+// answered by handle_request and serialized to a counting sink, so
+// the numbers cover parsing, routing, file access and serialization
+// without any socket in the way.
+namespace {
+
+using request_allocator = arena_allocator<char>;
+using request_body = http::basic_string_body<
+    char, std::char_traits<char>, request_allocator>;
+
+class client
+{
+    shared_state state_;
+    std::string wire_;
+    monotonic_arena arena_;
+    boost::optional<http::request_parser<request_body, request_allocator>> parser_;
+
+public:
+    explicit
+    client(std::string doc_root)
+        : state_(std::move(doc_root))
+    {
+    }
+
+    shared_state&
+    state() noexcept
+    {
+        return state_;
+    }
+
+    // Queue `depth` copies of a request as one pipelined batch,
+    // `fields` are extra header lines each ending in CRLF
+    void
+    load(beast::string_view target, std::size_t depth, beast::string_view fields)
+    {
+        wire_.clear();
+        for(std::size_t i = 0; i < depth; ++i)
+        {
+            wire_.append("GET ").append(target.data(), target.size());
+            wire_.append(" HTTP/1.1\r\n"
+                "Host: bench\r\n"
+                "User-Agent: flex-bench\r\n"
+                "Accept: */*\r\n");
+            wire_.append(fields.data(), fields.size());
+            wire_.append("\r\n");
+        }
+    }
+
+    // Answer every request of the batch, returns the response bytes
+    std::size_t
+    run_batch()
+    {
+        std::size_t bytes = 0;
+        std::size_t offset = 0;
+        while(offset < wire_.size())
+        {
+            parser_.reset();
+            arena_.reset();
+            parser_.emplace(
+                std::piecewise_construct,
+                std::make_tuple(request_allocator(arena_)),
+                std::make_tuple(request_allocator(arena_)));
+
+            beast::error_code ec;
+            while(! parser_->is_done())
+            {
+                offset += parser_->put(net::buffer(
+                    wire_.data() + offset, wire_.size() - offset), ec);
+                if(ec)
+                    std::abort();
+            }
+
+            auto res = handle_request(state_, parser_->release());
+            bytes += res.streamed() ? drain_streamed(res) : drain(res.message());
+        }
+        return bytes;
+    }
+
+private:
+    static std::size_t
+    drain(http::message_generator& res)
+    {
+        std::size_t bytes = 0;
+        beast::error_code ec;
+        while(! res.is_done())
+        {
+            auto const buffers = res.prepare(ec);
+            if(ec)
+                std::abort();
+            auto const n = beast::buffer_bytes(buffers);
+            bytes += n;
+            res.consume(n);
+        }
+        return bytes;
+    }
+
+    // Pull each piece from the source the way a session does,
+    // waiting for it if the source answers from another thread
+    static std::size_t
+    drain_streamed(response_message& res)
+    {
+        http::response_serializer<http::buffer_body, response_fields> sr(res.header());
+        std::size_t bytes = 0;
+        beast::error_code ec;
+        while(! sr.is_done())
+        {
+            std::promise<std::tuple<beast::error_code, net::const_buffer, bool>> piece;
+            res.source().async_next(
+                [&piece](beast::error_code ec, net::const_buffer data, bool more)
+                {
+                    piece.set_value({ec, data, more});
+                });
+            auto const next = piece.get_future().get();
+            if(std::get<0>(next))
+                std::abort();
+
+            auto& body = res.header().body();
+            body.data = const_cast<void*>(std::get<1>(next).data());
+            body.size = std::get<1>(next).size();
+            body.more = std::get<2>(next);
+            do
+            {
+                sr.next(ec,
+                    [&](beast::error_code&, auto const& buffers)
+                    {
+                        auto const n = beast::buffer_bytes(buffers);
+                        bytes += n;
+                        sr.consume(n);
+                    });
+            }
+            while(! ec && ! sr.is_done());
+            if(ec && ec != http::error::need_buffer)
+                std::abort();
+        }
+        return bytes;
+    }
+};
+
+// A token as /api/ws issues it, which listing the uploads requires
+std::string
+make_token()
+{
+    return jwt::create<jwt::traits::boost_json>()
+        .set_issuer("auth0")
+        .set_audience("aud0")
+        .set_expires_at(std::chrono::system_clock::now() + std::chrono::seconds{3600})
+        .sign(jwt::algorithm::hs256{"secret"});
+}
+
+void
+write_file(std::string const& path, std::size_t size)
+{
+    std::ofstream out(path, std::ios::binary);
+    std::string chunk(size, 'x');
+    out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+}
+
+void
+measure(
+    bench::reporter& report,
+    client& c,
+    std::string name,
+    beast::string_view target,
+    std::size_t depth,
+    std::uint64_t batches,
+    beast::string_view fields = {})
+{
+    c.load(target, depth, fields);
+    std::size_t bytes = 0;
+    for(std::uint64_t i = 0; i < batches / 10; ++i)
+        bytes += c.run_batch();
+
+    bytes = 0;
+    auto const start = std::chrono::steady_clock::now();
+    for(std::uint64_t i = 0; i < batches; ++i)
+        bytes += c.run_batch();
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    auto const requests = batches * depth;
+    report.add(std::move(name), requests, elapsed, {
+        {"requests_per_sec", bench::per_second(requests, elapsed)},
+        {"response_bytes", static_cast<double>(bytes) / static_cast<double>(requests)}});
+}
+
+} // namespace
+
+int main()
+{
+    char root[] = "/tmp/flex-bench-XXXXXX";
+    if(! ::mkdtemp(root))
+        return EXIT_FAILURE;
+    std::string const doc_root = root;
+    write_file(doc_root + "/index.html", 1024);
+    write_file(doc_root + "/large.bin", 64 * 1024);
+    write_file(doc_root + "/app.js", 64 * 1024);
+    write_file(doc_root + "/huge.bin", 4 * 1024 * 1024);
+    std::string const upload_dir = doc_root + "/uploads";
+    ::mkdir(upload_dir.c_str(), 0700);
+    for(int i = 0; i < 1000; ++i)
+        write_file(upload_dir + "/upload" + std::to_string(i) + ".bin", 0);
+
+    {
+        bench::reporter report("http");
+        client c(doc_root);
+        c.state().set_upload_dir(upload_dir);
+        measure(report, c, "keep_alive_1k", "/", 1, 100000);
+        measure(report, c, "keep_alive_64k", "/large.bin", 1, 20000);
+        measure(report, c, "keep_alive_4m", "/huge.bin", 1, 500);
+        measure(report, c, "pipelined_16x1k", "/index.html", 16, 10000);
+        measure(report, c, "revalidate_304", "/large.bin", 1, 100000,
+            "If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT\r\n");
+        measure(report, c, "range_4k", "/large.bin", 1, 50000,
+            "Range: bytes=4096-8191\r\n");
+        measure(report, c, "gzip_64k_cached", "/app.js", 1, 20000,
+            "Accept-Encoding: gzip, deflate\r\n");
+        measure(report, c, "not_found", "/missing.html", 1, 100000);
+        measure(report, c, "token", "/api/ws", 1, 20000);
+        measure(report, c, "chunked_listing_1000", "/api/uploads", 1, 2000,
+            "Authorization: Bearer " + make_token() + "\r\n");
+    }
+
+    for(int i = 0; i < 1000; ++i)
+        ::unlink((upload_dir + "/upload" + std::to_string(i) + ".bin").c_str());
+    ::rmdir(upload_dir.c_str());
+
+    ::unlink((doc_root + "/index.html").c_str());
+    ::unlink((doc_root + "/large.bin").c_str());
+    ::unlink((doc_root + "/app.js").c_str());
+    ::unlink((doc_root + "/huge.bin").c_str());
+    ::rmdir(root);
+}
@@ -0,0 +1,104 @@
+#include "../request_handler.hpp"
+#include "../query_string.hpp"
+#include "bench.hpp"
+
+// The small helpers on the request path. mime_type has its own
+// suite, mime-type-bench, which also keeps the old lookup as a
+// baseline.
+int main()
+{
+    bench::reporter report("micro");
+
+    report.run("path_cat", 2000000, []
+    {
+        auto path = path_cat("/var/www/html/", "/static/app/main.js");
+        bench::do_not_optimize(path);
+    });
+
+    report.run("common_headers", 2000000, []
+    {
+        response<http::empty_body> res{http::status::ok, 11};
+        add_common_headers(res, "text/html");
+        bench::do_not_optimize(res);
+    });
+
+    // The server's routes among a hundred API routes, lookup
+    // cost should follow the path and not the table size
+    using bench_request = http::request<http::string_body>;
+    auto routes = make_router<bench_request>();
+    for(int i = 0; i < 100; ++i)
+    {
+        routes.add(http::verb::get, "/api/v1/resource" + std::to_string(i) + "/:id",
+            [](route_context<bench_request>& ctx)
+            {
+                return error_response(ctx.request(), http::status::no_content, {});
+            });
+    }
+    auto const lookup = [&](beast::string_view path)
+    {
+        route_params params;
+        std::string allow;
+        auto const route = routes.find(http::verb::get, path, params, allow);
+        bench::do_not_optimize(route);
+    };
+
+    report.run("route_api_param", 5000000, [&]
+    {
+        lookup("/api/v1/resource42/1234");
+    });
+
+    report.run("route_static_file", 5000000, [&]
+    {
+        lookup("/static/app/main.js");
+    });
+
+    std::string const token =
+        "eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.eyJhdWQiOiJhdWQwIiwiaXNzIjoiYXV0aDAi"
+        "fQ.n5u9Fg2ylVd%2BqW3G3JhO%2F0b8oQp_zK1xXyZ4mR7tE2w";
+    std::string const target = "/ws?room=lobby%20one&token=" + token + "&v=2";
+    std::string decoded(token.size(), '\0');
+
+    report.run("query_string_find", 5000000, [&]
+    {
+        auto const value = query_string(target).find("token");
+        bench::do_not_optimize(value);
+    });
+
+    report.run("query_string_decode", 5000000, [&]
+    {
+        auto const n = query_string::decode(token, &decoded[0]);
+        bench::do_not_optimize(n);
+        bench::do_not_optimize(decoded);
+    });
+
+    // The token handle_request issues and the session verifies
+    auto const sign = []
+    {
+        return jwt::create<jwt::traits::boost_json>()
+            .set_issuer("auth0")
+            .set_audience("aud0")
+            .set_id(make_token_id())
+            .set_issued_at(std::chrono::system_clock::now())
+            .set_expires_at(std::chrono::system_clock::now() + std::chrono::seconds{3600})
+            .sign(jwt::algorithm::hs256{"secret"});
+    };
+
+    report.run("jwt_sign_hs256", 200000, [&]
+    {
+        auto const signed_token = sign();
+        bench::do_not_optimize(signed_token);
+    });
+
+    auto const issued = sign();
+    auto const verify = jwt::verify<jwt::traits::boost_json>()
+        .allow_algorithm(jwt::algorithm::hs256{"secret"})
+        .with_issuer("auth0")
+        .with_audience("aud0");
+
+    report.run("jwt_decode_verify_hs256", 200000, [&]
+    {
+        auto const decoded_token = jwt::decode<jwt::traits::boost_json>(issued);
+        verify.verify(decoded_token);
+        bench::do_not_optimize(decoded_token);
+    });
+}
@@ -0,0 +1,73 @@
+#include "../mime_types.hpp"
+#include "bench.hpp"
+#include <array>
+
+namespace {
+
+// The sequential iequals chain that mime_type replaced, kept as a baseline
+boost::beast::string_view
+legacy_mime_type(boost::beast::string_view path)
+{
+    using boost::beast::iequals;
+    auto const ext = [&path]
+    {
+        auto const pos = path.rfind(".");
+        if(pos == boost::beast::string_view::npos)
+            return boost::beast::string_view{};
+        return path.substr(pos);
+    }();
+    if(iequals(ext, ".htm"))  return "text/html";
+    if(iequals(ext, ".html")) return "text/html";
+    if(iequals(ext, ".php"))  return "text/html";
+    if(iequals(ext, ".css"))  return "text/css";
+    if(iequals(ext, ".txt"))  return "text/plain";
+    if(iequals(ext, ".js"))   return "application/javascript";
+    if(iequals(ext, ".json")) return "application/json";
+    if(iequals(ext, ".xml"))  return "application/xml";
+    if(iequals(ext, ".swf"))  return "application/x-shockwave-flash";
+    if(iequals(ext, ".flv"))  return "video/x-flv";
+    if(iequals(ext, ".png"))  return "image/png";
+    if(iequals(ext, ".jpe"))  return "image/jpeg";
+    if(iequals(ext, ".jpeg")) return "image/jpeg";
+    if(iequals(ext, ".jpg"))  return "image/jpeg";
+    if(iequals(ext, ".gif"))  return "image/gif";
+    if(iequals(ext, ".bmp"))  return "image/bmp";
+    if(iequals(ext, ".ico"))  return "image/vnd.microsoft.icon";
+    if(iequals(ext, ".tiff")) return "image/tiff";
+    if(iequals(ext, ".tif"))  return "image/tiff";
+    if(iequals(ext, ".svg"))  return "image/svg+xml";
+    if(iequals(ext, ".svgz")) return "image/svg+xml";
+    return "application/text";
+}
+
+// A mix of early, late, upper-case and unknown extensions
+std::array<boost::beast::string_view, 8> const paths{{
+    "/index.html",
+    "/static/app.js",
+    "/static/site.CSS",
+    "/img/logo.svgz",
+    "/img/photo.jpeg",
+    "/api/data.json",
+    "/download/archive.tar.gz",
+    "/README",
+}};
+
+} // namespace
+
+int main()
+{
+    bench::reporter report("mime_type");
+    std::uint64_t constexpr iterations = 10000000;
+
+    std::size_t i = 0;
+    report.run("legacy_iequals_chain", iterations, [&]
+    {
+        bench::do_not_optimize(legacy_mime_type(paths[i++ & 7]));
+    });
+
+    i = 0;
+    report.run("perfect_hash", iterations, [&]
+    {
+        bench::do_not_optimize(mime_type(paths[i++ & 7]));
+    });
+}
@@ -0,0 +1,73 @@
+#include "../common/server_certificate.hpp"
+#include "bench.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/ssl.hpp>
+#include <cstdlib>
+
+// Full TLS handshakes per second with the server's own context.
+// Both ends run on one thread over a socket pair, so the result is
+// the CPU cost of a handshake rather than a network round trip.
+// Run it from the build directory, where the certificates live.
+namespace net = boost::asio;
+namespace ssl = boost::asio::ssl;
+
+namespace {
+
+using socket_type = net::local::stream_protocol::socket;
+
+std::chrono::nanoseconds
+handshake(net::io_context& ioc, ssl::context& server_ctx, ssl::context& client_ctx)
+{
+    ssl::stream<socket_type> server(ioc, server_ctx);
+    ssl::stream<socket_type> client(ioc, client_ctx);
+    net::local::connect_pair(server.next_layer(), client.next_layer());
+
+    auto const start = std::chrono::steady_clock::now();
+    auto const check = [](boost::system::error_code ec)
+    {
+        if(ec)
+        {
+            std::fprintf(stderr, "handshake: %s\n", ec.message().c_str());
+            std::abort();
+        }
+    };
+    server.async_handshake(ssl::stream_base::server, check);
+    client.async_handshake(ssl::stream_base::client, check);
+    ioc.restart();
+    ioc.run();
+    return std::chrono::steady_clock::now() - start;
+}
+
+} // namespace
+
+int main()
+{
+    ssl::context server_ctx{ssl::context::tlsv13};
+    setup_ssl_context(server_ctx);
+
+    // No session cache on the client, every handshake is a full one
+    ssl::context client_ctx{ssl::context::tlsv13};
+    client_ctx.set_verify_mode(ssl::verify_none);
+    SSL_CTX_set_session_cache_mode(client_ctx.native_handle(), SSL_SESS_CACHE_OFF);
+
+    net::io_context ioc{1};
+    std::uint64_t constexpr iterations = 2000;
+    for(std::uint64_t i = 0; i < iterations / 10; ++i)
+        handshake(ioc, server_ctx, client_ctx);
+
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(iterations);
+    std::chrono::nanoseconds elapsed{0};
+    for(std::uint64_t i = 0; i < iterations; ++i)
+    {
+        samples.push_back(handshake(ioc, server_ctx, client_ctx));
+        elapsed += samples.back();
+    }
+
+    bench::reporter report("tls");
+    auto extra = bench::percentiles(std::move(samples));
+    extra.insert(extra.begin(), {"handshakes_per_sec", bench::per_second(iterations, elapsed)});
+    report.add("full_handshake_tls13", iterations, elapsed, std::move(extra));
+}
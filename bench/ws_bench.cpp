@@ -0,0 +1,254 @@
+#include "../listener.hpp"
+#include "bench.hpp"
+#include <boost/json.hpp>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+// WebSocket echo and broadcast latency and throughput against an
+// in-process server. The server side is the real accept path, from
+// detection through the HTTP upgrade and token check, on its own io
+// thread; clients are plain blocking sockets on the loopback interface.
+namespace {
+
+// Fetch a token from /api/ws the way a browser would
+std::string
+fetch_token(tcp::endpoint const& ep)
+{
+    net::io_context ioc;
+    beast::tcp_stream stream(ioc);
+    stream.connect(ep);
+
+    http::request<http::empty_body> req{http::verb::get, "/api/ws", 11};
+    req.set(http::field::host, "bench");
+    http::write(stream, req);
+
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(stream, buffer, res);
+    return boost::json::value_to<std::string>(boost::json::parse(res.body()));
+}
+
+class client
+{
+    net::io_context ioc_;
+    websocket::stream<tcp::socket> ws_{ioc_};
+    beast::flat_buffer buffer_;
+    std::string payload_;
+
+public:
+    client(tcp::endpoint const& ep, std::string const& token, std::size_t size)
+        : payload_(size, 'x')
+    {
+        ws_.next_layer().connect(ep);
+        ws_.next_layer().set_option(tcp::no_delay(true));
+        ws_.handshake("bench", "/?token=" + token);
+    }
+
+    ~client()
+    {
+        beast::error_code ec;
+        ws_.close(websocket::close_code::normal, ec);
+    }
+
+    // One message out and its echo back
+    std::chrono::nanoseconds
+    round_trip()
+    {
+        auto const start = std::chrono::steady_clock::now();
+        ws_.write(net::buffer(payload_));
+        ws_.read(buffer_);
+        buffer_.consume(buffer_.size());
+        return std::chrono::steady_clock::now() - start;
+    }
+
+    // Wait for the next message from the server
+    void
+    receive()
+    {
+        ws_.read(buffer_);
+        buffer_.consume(buffer_.size());
+    }
+};
+
+void
+measure(
+    bench::reporter& report,
+    tcp::endpoint const& ep,
+    std::string const& token,
+    std::string name,
+    std::size_t connections,
+    std::size_t size,
+    std::uint64_t messages)
+{
+    std::vector<std::unique_ptr<client>> clients;
+    for(std::size_t i = 0; i < connections; ++i)
+        clients.push_back(std::make_unique<client>(ep, token, size));
+
+    std::mutex mutex;
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(messages * connections);
+
+    auto const start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(auto& c : clients)
+        threads.emplace_back([&, c = c.get()]
+        {
+            std::vector<std::chrono::nanoseconds> local;
+            local.reserve(messages);
+            for(std::uint64_t i = 0; i < messages / 10; ++i)
+                c->round_trip();
+            for(std::uint64_t i = 0; i < messages; ++i)
+                local.push_back(c->round_trip());
+            std::lock_guard<std::mutex> lock(mutex);
+            samples.insert(samples.end(), local.begin(), local.end());
+        });
+    for(auto& t : threads)
+        t.join();
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    auto const total = messages * connections;
+    auto extra = bench::percentiles(std::move(samples));
+    extra.insert(extra.begin(), {"messages_per_sec", bench::per_second(total, elapsed)});
+    report.add(std::move(name), total, elapsed, std::move(extra));
+}
+
+// One broadcast to every connection, timed until the last of them has
+// received it. The echo before starting makes sure each session has
+// subscribed.
+void
+measure_broadcast(
+    bench::reporter& report,
+    tcp::endpoint const& ep,
+    std::string const& token,
+    shared_state& state,
+    std::string name,
+    std::size_t connections,
+    std::size_t size,
+    std::uint64_t messages)
+{
+    std::vector<std::unique_ptr<client>> clients;
+    for(std::size_t i = 0; i < connections; ++i)
+    {
+        clients.push_back(std::make_unique<client>(ep, token, size));
+        clients.back()->round_trip();
+    }
+
+    std::string const payload(size, 'x');
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(messages);
+
+    auto const start = std::chrono::steady_clock::now();
+    for(std::uint64_t i = 0; i < messages; ++i)
+    {
+        auto const sent = std::chrono::steady_clock::now();
+        state.broadcasts().publish(payload);
+        for(auto& c : clients)
+            c->receive();
+        samples.push_back(std::chrono::steady_clock::now() - sent);
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    auto const total = messages * connections;
+    auto extra = bench::percentiles(std::move(samples));
+    extra.insert(extra.begin(), {"deliveries_per_sec", bench::per_second(total, elapsed)});
+    report.add(std::move(name), messages, elapsed, std::move(extra));
+}
+
+// Broadcast latency and throughput to an open event stream
+void
+measure_event_stream(
+    bench::reporter& report,
+    tcp::endpoint const& ep,
+    std::string const& token,
+    shared_state& state,
+    std::string name,
+    std::size_t size,
+    std::uint64_t messages)
+{
+    net::io_context ioc;
+    tcp::socket socket(ioc);
+    socket.connect(ep);
+
+    http::request<http::empty_body> req{http::verb::get, "/api/events?token=" + token, 11};
+    req.set(http::field::host, "bench");
+    http::write(socket, req);
+
+    beast::flat_buffer buffer;
+    http::response_parser<http::buffer_body> parser;
+    http::read_header(socket, buffer, parser);
+
+    // Wait for the next event, each one ends with a blank line
+    std::string received;
+    auto const next_event = [&]
+    {
+        char piece[4096];
+        for(;;)
+        {
+            auto const end = received.find("\n\n");
+            if(end != std::string::npos)
+            {
+                received.erase(0, end + 2);
+                return;
+            }
+            parser.get().body().data = piece;
+            parser.get().body().size = sizeof(piece);
+            beast::error_code ec;
+            http::read_some(socket, buffer, parser, ec);
+            if(ec && ec != http::error::need_buffer)
+                throw beast::system_error{ec};
+            received.append(piece, sizeof(piece) - parser.get().body().size);
+        }
+    };
+
+    next_event();   // the preamble
+
+    std::string const payload(size, 'x');
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(messages);
+
+    auto const start = std::chrono::steady_clock::now();
+    for(std::uint64_t i = 0; i < messages; ++i)
+    {
+        auto const sent = std::chrono::steady_clock::now();
+        state.broadcasts().publish(payload);
+        next_event();
+        samples.push_back(std::chrono::steady_clock::now() - sent);
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    auto extra = bench::percentiles(std::move(samples));
+    extra.insert(extra.begin(), {"events_per_sec", bench::per_second(messages, elapsed)});
+    report.add(std::move(name), messages, elapsed, std::move(extra));
+}
+
+} // namespace
+
+int main()
+{
+    logging::set_level(logging::level::error);
+
+    // Plain connections only, the TLS cost is measured by tls-bench
+    net::io_context ioc{1};
+    ssl::context ctx{ssl::context::tlsv13};
+    auto const state = std::make_shared<shared_state>(".");
+    auto const server = std::make_shared<listener>(
+        ioc, ctx, tcp::endpoint{net::ip::make_address("127.0.0.1"), 0}, state);
+    server->run();
+    auto const ep = server->local_endpoint();
+    std::thread io([&ioc] { ioc.run(); });
+
+    {
+        auto const token = fetch_token(ep);
+        bench::reporter report("websocket");
+        measure(report, ep, token, "echo_64b", 1, 64, 20000);
+        measure(report, ep, token, "echo_4k", 1, 4096, 10000);
+        measure(report, ep, token, "echo_64b_8_connections", 8, 64, 5000);
+        measure_broadcast(report, ep, token, *state, "broadcast_64b_64_connections", 64, 64, 2000);
+        measure_event_stream(report, ep, token, *state, "event_stream_64b", 64, 2000);
+    }
+
+    ioc.stop();
+    io.join();
+    logging::flush();
+}
@@ -0,0 +1,105 @@
+#ifndef IR_WEBSOCKET_SERVER_BODY_SINK_HPP
+#define IR_WEBSOCKET_SERVER_BODY_SINK_HPP
+
+#include "base.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Receives a streamed request body a piece at a time, as the session
+// reads it, so that an upload never has to fit in memory.
+class body_sink
+{
+public:
+    virtual ~body_sink() = default;
+
+    // Take the next piece of the body
+    virtual void write(net::const_buffer piece, beast::error_code &ec) = 0;
+
+    // Called once the whole body has been written
+    virtual void finish(beast::error_code &ec) = 0;
+};
+
+// Writes a body to a file. It goes to "<path>.XXXXXX.part" first, a
+// name of its own made by mkostemps, and is renamed into place when
+// complete. A reader never sees half an upload, a failed one leaves
+// nothing behind, and two uploads of one name never share a file.
+class file_sink : public body_sink
+{
+    std::string path_;
+    std::string part_;
+    beast::file file_;
+    std::uint64_t size_ = 0;
+    bool done_ = false;
+
+public:
+    file_sink(std::string path, beast::error_code &ec)
+        : path_(std::move(path)), part_(path_ + ".XXXXXX.part")
+    {
+        auto const fd = ::mkostemps(&part_[0], 5, O_CLOEXEC);
+        if (fd < 0)
+        {
+            ec.assign(errno, beast::system_category());
+            part_.clear();
+            return;
+        }
+
+        // mkostemps creates the file for its owner only
+        ::fchmod(fd, 0644);
+        file_.native_handle(fd);
+        ec = {};
+    }
+
+    ~file_sink()
+    {
+        if (!done_ && !part_.empty())
+        {
+            beast::error_code ec;
+            file_.close(ec);
+            std::remove(part_.c_str());
+        }
+    }
+
+    // Bytes written so far
+    std::uint64_t
+    size() const noexcept
+    {
+        return size_;
+    }
+
+    void
+    write(net::const_buffer piece, beast::error_code &ec) override
+    {
+        auto data = static_cast<char const *>(piece.data());
+        auto n = piece.size();
+        while (n > 0)
+        {
+            auto const written = file_.write(data, n, ec);
+            if (ec)
+                return;
+            data += written;
+            n -= written;
+            size_ += written;
+        }
+    }
+
+    void
+    finish(beast::error_code &ec) override
+    {
+        file_.close(ec);
+        if (ec)
+            return;
+        if (std::rename(part_.c_str(), path_.c_str()) != 0)
+        {
+            ec.assign(errno, beast::system_category());
+            std::remove(part_.c_str());
+        }
+        done_ = true;
+    }
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef IR_WEBSOCKET_SERVER_BODY_SOURCE_HPP
+#define IR_WEBSOCKET_SERVER_BODY_SOURCE_HPP
+
+#include "base.hpp"
+#include "response_headers.hpp"
+#include <boost/make_unique.hpp>
+#include <boost/optional.hpp>
+#include <functional>
+#include <memory>
+#include <utility>
+
+// A response body produced asynchronously, a piece at a time.
+//
+// The session asks for the next piece only after the previous one
+// has been written, so a slow client holds the producer back instead
+// of letting data pile up in memory.
+class body_source
+{
+public:
+    // Called with the next piece, and whether more follow. The piece
+    // must stay valid until the next call to async_next or until the
+    // source is destroyed. It may be empty, even when more follow.
+    using handler_type = std::function<void(beast::error_code, net::const_buffer, bool)>;
+
+    virtual ~body_source() = default;
+
+    // Produce the next piece. The handler may be called before this
+    // returns or later from any thread, the session takes care of
+    // getting back to its own executor. It holds the session weakly,
+    // so a source which keeps it must not count on the session, or
+    // itself, staying alive meanwhile.
+    virtual void async_next(handler_type handler) = 0;
+};
+
+// What handle_request returns. Most responses are complete messages
+// which the session serializes through a generator; a streamed one is
+// a header and a body_source whose pieces become the body.
+class response_message
+{
+    boost::optional<http::message_generator> message_;
+    std::unique_ptr<response<http::buffer_body>> header_;
+    std::shared_ptr<body_source> source_;
+
+public:
+    template <class Body, class Fields>
+    response_message(http::response<Body, Fields> &&res)
+        : message_(std::move(res))
+    {
+    }
+
+    response_message(http::message_generator &&message)
+        : message_(std::move(message))
+    {
+    }
+
+    // The header should declare a Content-Length or chunked encoding,
+    // the body is filled in from the source as the response is written
+    response_message(
+        response<http::buffer_body> &&header,
+        std::shared_ptr<body_source> source)
+        : header_(boost::make_unique<response<http::buffer_body>>(std::move(header))),
+          source_(std::move(source))
+    {
+    }
+
+    bool
+    streamed() const noexcept
+    {
+        return source_ != nullptr;
+    }
+
+    http::message_generator &
+    message() noexcept
+    {
+        return *message_;
+    }
+
+    response<http::buffer_body> &
+    header() noexcept
+    {
+        return *header_;
+    }
+
+    body_source &
+    source() noexcept
+    {
+        return *source_;
+    }
+
+    bool
+    keep_alive() noexcept
+    {
+        return message_ ? message_->keep_alive() : header_->keep_alive();
+    }
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "broadcast.hpp"
+#include <algorithm>
+
+namespace {
+
+// An event in text/event-stream framing. A line break in the message
+// starts a new "data:" line, which the client joins back with "\n".
+std::string
+sse_frame(std::uint64_t id, boost::beast::string_view message)
+{
+    std::string frame;
+    frame.reserve(message.size() + 32);
+    frame.append("id: ").append(std::to_string(id)).append("\n");
+    for (;;)
+    {
+        auto const end = message.find_first_of("\r\n");
+        auto const line = message.substr(0, end);
+        frame.append("data: ").append(line.data(), line.size()).append("\n");
+        if (end == boost::beast::string_view::npos)
+            break;
+        auto next = end + 1;
+        if (message[end] == '\r' && next < message.size() && message[next] == '\n')
+            ++next;
+        message.remove_prefix(next);
+    }
+    frame.append("\n");
+    return frame;
+}
+
+} // namespace
+
+std::vector<std::shared_ptr<broadcast_subscriber>>
+broadcast_hub::
+    live()
+{
+    std::vector<std::shared_ptr<broadcast_subscriber>> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    result.reserve(subscribers_.size());
+    subscribers_.erase(
+        std::remove_if(subscribers_.begin(), subscribers_.end(),
+            [&result](std::weak_ptr<broadcast_subscriber> const &weak)
+            {
+                auto subscriber = weak.lock();
+                if (!subscriber)
+                    return true;
+                result.push_back(std::move(subscriber));
+                return false;
+            }),
+        subscribers_.end());
+    return result;
+}
+
+void
+broadcast_hub::
+    subscribe(std::shared_ptr<broadcast_subscriber> const &subscriber)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    subscribers_.push_back(subscriber);
+}
+
+std::size_t
+broadcast_hub::
+    publish(boost::beast::string_view message)
+{
+    std::uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_id_++;
+    }
+    broadcast_event const event{
+        std::make_shared<std::string const>(message.data(), message.size()),
+        std::make_shared<std::string const>(sse_frame(id, message))};
+
+    auto const subscribers = live();
+    for (auto const &subscriber : subscribers)
+        subscriber->deliver(event);
+    return subscribers.size();
+}
+
+void
+broadcast_hub::
+    heartbeat()
+{
+    static auto const comment = std::make_shared<std::string const>(": heartbeat\n\n");
+    broadcast_event const event{nullptr, comment};
+    for (auto const &subscriber : live())
+        subscriber->deliver(event);
+}
+
+std::shared_ptr<std::string const> const &
+broadcast_hub::
+    stream_preamble()
+{
+    // Sent at once so the client sees the header without waiting for
+    // the first event, and told how soon to reconnect
+    static auto const preamble = std::make_shared<std::string const>("retry: 3000\n\n");
+    return preamble;
+}
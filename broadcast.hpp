@@ -0,0 +1,66 @@
+#ifndef IR_WEBSOCKET_SERVER_BROADCAST_HPP
+#define IR_WEBSOCKET_SERVER_BROADCAST_HPP
+
+#include <boost/beast/core/string.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A broadcast message in every form a subscriber sends it. Each is
+// serialized once per broadcast and shared by all the subscribers.
+struct broadcast_event
+{
+    std::shared_ptr<std::string const> text;    // a WebSocket text message, null for a heartbeat
+    std::shared_ptr<std::string const> sse;     // a text/event-stream frame
+};
+
+// Something which sends broadcasts to a client
+class broadcast_subscriber
+{
+public:
+    virtual ~broadcast_subscriber() = default;
+
+    // Called from any thread, so it must hand the event over to the
+    // subscriber's own executor rather than write it here
+    virtual void deliver(broadcast_event const &event) = 0;
+};
+
+// Fans messages out to every WebSocket session and event stream.
+//
+// Subscribers are held weakly, one which goes away is simply dropped
+// at the next broadcast, so nothing needs to unsubscribe. Publishing
+// serializes the message once and only copies pointers under the lock.
+class broadcast_hub
+{
+    std::mutex mutex_;
+    std::vector<std::weak_ptr<broadcast_subscriber>> subscribers_;
+    std::uint64_t next_id_ = 1;
+
+    std::vector<std::shared_ptr<broadcast_subscriber>> live();
+
+public:
+    // Events a subscriber may have waiting before new ones are
+    // dropped for it, so a stalled client cannot grow without bound
+    static constexpr std::size_t max_backlog = 256;
+
+    // How often idle event streams get a comment to keep them open
+    static constexpr std::chrono::seconds heartbeat_interval{15};
+
+    void subscribe(std::shared_ptr<broadcast_subscriber> const &subscriber);
+
+    // Send a message to every subscriber, returns how many there were
+    std::size_t publish(boost::beast::string_view message);
+
+    // Send a comment to the event streams, which keeps proxies from
+    // closing them and finds clients which went away
+    void heartbeat();
+
+    // Returns the serialized frame which starts every event stream
+    static std::shared_ptr<std::string const> const &stream_preamble();
+};
+
+#endif
@@ -0,0 +1,144 @@
+#include "compression.hpp"
+#include <boost/asio/post.hpp>
+#include <boost/beast/core/file.hpp>
+#include <zlib.h>
+
+bool
+compress(boost::beast::string_view in, compression c, std::string &out)
+{
+    z_stream zs{};
+    // 15 window bits for a zlib stream, plus 16 for a gzip member
+    auto const window_bits = c == compression::gzip ? 15 + 16 : 15;
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+            window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    out.resize(deflateBound(&zs, static_cast<uLong>(in.size())));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+
+    // deflateBound leaves room for everything, so one call finishes
+    auto const result = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return result == Z_STREAM_END;
+}
+
+std::string
+compression_cache::
+    make_key(file_info const &info, compression c)
+{
+    auto key = info.etag;
+    key.append(to_string(c).data(), to_string(c).size());
+    return key;
+}
+
+std::shared_ptr<std::string const>
+compression_cache::
+    find(file_info const &info, compression c)
+{
+    auto const key = make_key(info, c);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = index_.find(key);
+    if (it == index_.end())
+        return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->data;
+}
+
+void
+compression_cache::
+    prepare(boost::asio::thread_pool &pool, std::string const &path,
+        file_info const &info, compression c)
+{
+    auto key = make_key(info, c);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.count(key) != 0 || !pending_.insert(key).second)
+            return;
+    }
+
+    // The pool is joined before the cache is destroyed
+    boost::asio::post(pool,
+        [this, path, size = info.size, c, key = std::move(key)]
+        {
+            make(path, size, c, key);
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.erase(key);
+        });
+}
+
+void
+compression_cache::
+    make(std::string const &path, std::uint64_t size, compression c,
+        std::string const &key)
+{
+    // A file which cannot be read or compressed is left out,
+    // and the request which finds it missing reports why
+    boost::beast::error_code ec;
+    boost::beast::file file;
+    file.open(path.c_str(), boost::beast::file_mode::scan, ec);
+    if (ec)
+        return;
+    std::string contents(static_cast<std::size_t>(size), '\0');
+    std::size_t n = 0;
+    while (n < contents.size())
+    {
+        auto const got = file.read(&contents[n], contents.size() - n, ec);
+        if (ec)
+            return;
+        if (got == 0)
+            break;
+        n += got;
+    }
+    contents.resize(n);
+
+    auto data = std::make_shared<std::string>();
+    if (!compress(contents, c, *data))
+        return;
+    data->shrink_to_fit();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.count(key) != 0)
+        return;
+
+    lru_.push_front({key, path, data});
+    index_.emplace(key, lru_.begin());
+    bytes_ += data->size();
+    while (bytes_ > capacity_ && lru_.size() > 1)
+    {
+        bytes_ -= lru_.back().data->size();
+        index_.erase(lru_.back().key);
+        lru_.pop_back();
+    }
+}
+
+void
+compression_cache::
+    invalidate(std::string const &path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = lru_.begin(); it != lru_.end();)
+    {
+        if (it->path != path)
+        {
+            ++it;
+            continue;
+        }
+        bytes_ -= it->data->size();
+        index_.erase(it->key);
+        it = lru_.erase(it);
+    }
+}
+
+void
+compression_cache::
+    clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
@@ -0,0 +1,92 @@
+#ifndef IR_WEBSOCKET_SERVER_COMPRESSION_HPP
+#define IR_WEBSOCKET_SERVER_COMPRESSION_HPP
+
+#include "file_cache.hpp"
+#include <boost/asio/thread_pool.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/string.hpp>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// Content codings the server can apply itself
+enum class compression
+{
+    gzip,
+    deflate     // a zlib stream, as HTTP defines "deflate"
+};
+
+inline boost::beast::string_view
+to_string(compression c) noexcept
+{
+    return c == compression::gzip ? "gzip" : "deflate";
+}
+
+// Bodies smaller than this are sent as they are,
+// the framing overhead eats most of the gain
+constexpr std::uint64_t min_compress_size = 256;
+
+// Compress `in` at the default level. Returns false on failure.
+bool compress(boost::beast::string_view in, compression c, std::string &out);
+
+// Compressed copies of static files, so that each version of a file
+// is compressed once per coding. Entries are keyed by the file's
+// ETag, which changes with its inode, mtime and size, and the least
+// recently used are dropped when the total size passes the capacity.
+// Copies are made on a thread pool; until one is ready the file is
+// sent as it is.
+class compression_cache
+{
+public:
+    // Larger files are sent uncompressed
+    static constexpr std::uint64_t max_file_size = 8 * 1024 * 1024;
+
+    explicit compression_cache(std::uint64_t capacity = 64 * 1024 * 1024)
+        : capacity_(capacity)
+    {
+    }
+
+    // Return the compressed copy of this version of the file,
+    // or null if it has not been made yet
+    std::shared_ptr<std::string const>
+    find(file_info const &info, compression c);
+
+    // Compress the file on `pool`, unless a copy is
+    // already there or being made
+    void
+    prepare(boost::asio::thread_pool &pool, std::string const &path,
+        file_info const &info, compression c);
+
+    // Forget every copy of one file, or everything
+    void invalidate(std::string const &path);
+    void clear();
+
+private:
+    struct entry
+    {
+        std::string key;
+        std::string path;
+        std::shared_ptr<std::string const> data;
+    };
+
+    static std::string
+    make_key(file_info const &info, compression c);
+
+    // Read and compress the file, then insert the copy
+    void
+    make(std::string const &path, std::uint64_t size, compression c,
+        std::string const &key);
+
+    std::mutex mutex_;
+    std::list<entry> lru_;  // most recently used first
+    std::unordered_map<std::string, std::list<entry>::iterator> index_;
+    std::unordered_set<std::string> pending_;
+    std::uint64_t bytes_ = 0;
+    std::uint64_t capacity_;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef IR_WEBSOCKET_SERVER_CONTENT_CODING_HPP
+#define IR_WEBSOCKET_SERVER_CONTENT_CODING_HPP
+
+#include <boost/beast/core/string.hpp>
+
+// Returns the weight, from 0 to 1000, that an Accept-Encoding field
+// value gives a content coding. A coding the field does not name gets
+// the weight of "*", or 0 if that is absent too, so 0 always means
+// the coding must not be sent.
+inline int
+accept_weight(boost::beast::string_view field, boost::beast::string_view coding) noexcept
+{
+    using boost::beast::string_view;
+
+    auto const trim = [](string_view v)
+    {
+        while (!v.empty() && (v.front() == ' ' || v.front() == '\t'))
+            v.remove_prefix(1);
+        while (!v.empty() && (v.back() == ' ' || v.back() == '\t'))
+            v.remove_suffix(1);
+        return v;
+    };
+
+    // "q=0.5" as 500, anything malformed as 0
+    auto const weight = [&trim](string_view params)
+    {
+        while (!params.empty())
+        {
+            auto const semi = params.find(';');
+            auto const param = trim(params.substr(0, semi));
+            if (param.size() >= 3 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+            {
+                auto const q = param.substr(2);
+                if (q[0] == '1')
+                    return 1000;
+                int w = 0;
+                int scale = 100;
+                for (auto c : q.substr(q.size() > 1 ? 2 : 1))
+                {
+                    if (c < '0' || c > '9' || scale == 0)
+                        break;
+                    w += (c - '0') * scale;
+                    scale /= 10;
+                }
+                return w;
+            }
+            if (semi == string_view::npos)
+                break;
+            params.remove_prefix(semi + 1);
+        }
+        return 1000;
+    };
+
+    int any = 0;
+    while (!field.empty())
+    {
+        auto const comma = field.find(',');
+        auto const entry = field.substr(0, comma);
+        auto const semi = entry.find(';');
+        auto const name = trim(entry.substr(0, semi));
+        auto const params = semi == string_view::npos ? string_view{} : entry.substr(semi + 1);
+
+        if (boost::beast::iequals(name, coding) ||
+            (coding == "gzip" && boost::beast::iequals(name, "x-gzip")))
+            return weight(params);
+        if (name == "*")
+            any = weight(params);
+
+        if (comma == string_view::npos)
+            break;
+        field.remove_prefix(comma + 1);
+    }
+    return any;
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "directory_listing.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+
+void
+append_json_string(std::string &out, beast::string_view s)
+{
+    out += '"';
+    for (auto const c : s)
+    {
+        switch (c)
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escaped[7];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            }
+            else
+                out += c;
+        }
+    }
+    out += '"';
+}
+
+} // namespace
+
+void
+directory_listing::closer::
+operator()(void *dir) const noexcept
+{
+    ::closedir(static_cast<DIR *>(dir));
+}
+
+void
+directory_listing::
+    open(char const *path, beast::error_code &ec)
+{
+    dir_.reset(::opendir(path));
+    if (!dir_)
+    {
+        ec.assign(errno, beast::system_category());
+        return;
+    }
+    ec = {};
+}
+
+bool
+directory_listing::
+    next(std::string &chunk, beast::error_code &ec)
+{
+    auto const dir = static_cast<DIR *>(dir_.get());
+    if (!started_)
+    {
+        chunk += '[';
+        started_ = true;
+    }
+
+    while (chunk.size() < chunk_size)
+    {
+        errno = 0;
+        auto const e = ::readdir(dir);
+        if (!e)
+        {
+            if (errno != 0)
+            {
+                ec.assign(errno, beast::system_category());
+                return false;
+            }
+            chunk += ']';
+            return false;
+        }
+
+        beast::string_view const name = e->d_name;
+        if (name.front() == '.' || name.ends_with(".part"))
+            continue;
+        struct stat st;
+        if (::fstatat(::dirfd(dir), e->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if (!first_)
+            chunk += ',';
+        first_ = false;
+        chunk += "{\"name\":";
+        append_json_string(chunk, name);
+        chunk += ",\"size\":";
+        chunk += std::to_string(st.st_size);
+        chunk += '}';
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef IR_WEBSOCKET_SERVER_DIRECTORY_LISTING_HPP
+#define IR_WEBSOCKET_SERVER_DIRECTORY_LISTING_HPP
+
+#include "base.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// The regular files of a directory as a JSON array of
+// {"name": ..., "size": ...}, produced a batch of entries at a time
+// so that a large directory is never listed into memory at once.
+// Hidden files and unfinished uploads are left out.
+class directory_listing
+{
+    struct closer
+    {
+        void operator()(void *dir) const noexcept;
+    };
+
+    std::unique_ptr<void, closer> dir_;    // DIR*
+    bool started_ = false;
+    bool first_ = true;
+
+public:
+    // Roughly how much each call to next appends
+    static constexpr std::size_t chunk_size = 16 * 1024;
+
+    void open(char const *path, beast::error_code &ec);
+
+    // Append the next entries to chunk, returning false once the
+    // array is complete
+    bool next(std::string &chunk, beast::error_code &ec);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "event_stream.hpp"
+#include "metrics.hpp"
+
+event_stream::
+    event_stream()
+{
+    backlog_.push_back(broadcast_hub::stream_preamble());
+    metrics::add(metrics::gauge::event_streams, 1);
+}
+
+event_stream::
+    ~event_stream()
+{
+    metrics::add(metrics::gauge::event_streams, -1);
+}
+
+void
+event_stream::
+    async_next(handler_type handler)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    current_.reset();
+    if (backlog_.empty())
+    {
+        waiting_ = std::move(handler);
+        return;
+    }
+    current_ = std::move(backlog_.front());
+    backlog_.pop_front();
+    lock.unlock();
+    handler({}, net::buffer(*current_), true);
+}
+
+void
+event_stream::
+    deliver(broadcast_event const &event)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (waiting_)
+    {
+        current_ = event.sse;
+        auto handler = std::move(waiting_);
+        waiting_ = nullptr;
+        lock.unlock();
+        handler({}, net::buffer(*current_), true);
+        return;
+    }
+
+    // A heartbeat is only needed while the stream is idle
+    if (!event.text)
+        return;
+    if (backlog_.size() >= broadcast_hub::max_backlog)
+    {
+        metrics::add(metrics::counter::broadcast_dropped);
+        return;
+    }
+    backlog_.push_back(event.sse);
+}
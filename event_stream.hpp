@@ -0,0 +1,37 @@
+#ifndef IR_WEBSOCKET_SERVER_EVENT_STREAM_HPP
+#define IR_WEBSOCKET_SERVER_EVENT_STREAM_HPP
+
+#include "body_source.hpp"
+#include "broadcast.hpp"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// The body of a text/event-stream response, which never ends.
+//
+// Broadcasts arrive already in SSE framing and are queued until the
+// session asks for the next piece, which it does once the previous one
+// has been written. A session waiting for an event has no write
+// pending on its socket, the next event or heartbeat wakes it up.
+// The handler kept meanwhile holds the session weakly, as the
+// session owns this stream.
+class event_stream
+    : public body_source,
+      public broadcast_subscriber
+{
+    std::mutex mutex_;
+    std::deque<std::shared_ptr<std::string const>> backlog_;
+    std::shared_ptr<std::string const> current_;   // being written
+    handler_type waiting_;
+
+public:
+    event_stream();
+    ~event_stream();
+
+    void async_next(handler_type handler) override;
+
+    void deliver(broadcast_event const &event) override;
+};
+
+#endif
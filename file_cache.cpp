@@ -0,0 +1,175 @@
+#include "file_cache.hpp"
+#include "response_headers.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <sys/stat.h>
+
+namespace {
+
+// Any change which rewrites or replaces a file moves one of these
+std::string
+make_etag(struct stat const &st)
+{
+    char etag[64];
+    auto const n = std::snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx\"",
+        static_cast<unsigned long long>(st.st_ino),
+        static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ull +
+            static_cast<unsigned long long>(st.st_mtim.tv_nsec),
+        static_cast<unsigned long long>(st.st_size));
+    return std::string(etag, static_cast<std::size_t>(n));
+}
+
+// A precompressed sibling is only trusted if it is not older than
+// the file, so a stale one left behind by a deploy is never served
+boost::optional<file_variant>
+make_variant(std::string const &path, struct stat const &source)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_mtim.tv_sec < source.st_mtim.tv_sec)
+        return boost::none;
+    file_variant v;
+    v.size = static_cast<std::uint64_t>(st.st_size);
+    v.etag = make_etag(st);
+    return v;
+}
+
+std::shared_ptr<file_info const>
+make_info(std::string const &path, boost::beast::error_code &ec)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+    {
+        ec.assign(errno, boost::beast::system_category());
+        return nullptr;
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        ec = boost::beast::errc::make_error_code(
+            boost::beast::errc::no_such_file_or_directory);
+        return nullptr;
+    }
+
+    auto info = std::make_shared<file_info>();
+    info->size = static_cast<std::uint64_t>(st.st_size);
+    info->mtime = st.st_mtim.tv_sec;
+    info->checked = std::chrono::steady_clock::now();
+    info->etag = make_etag(st);
+    info->last_modified.resize(29);
+    detail::format_http_date(info->mtime, &info->last_modified[0]);
+    info->brotli = make_variant(path + ".br", st);
+    info->gzip = make_variant(path + ".gz", st);
+
+    ec = {};
+    return info;
+}
+
+} // namespace
+
+std::shared_ptr<file_info const>
+file_cache::
+    lookup(std::string const &path, boost::beast::error_code &ec)
+{
+    auto &s = shard_for(path);
+    auto const now = std::chrono::steady_clock::now();
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto const it = s.entries.find(path);
+        if (it != s.entries.end() && now - it->second->checked < ttl_)
+        {
+            ec = {};
+            return it->second;
+        }
+        generation = s.generation;
+    }
+
+    // stat() outside the lock, a racing lookup of the
+    // same path at worst does the same work twice
+    auto info = make_info(path, ec);
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    // The file changed while it was read, the result is
+    // returned but not kept
+    if (s.generation != generation)
+        return info;
+    if (!info)
+    {
+        s.entries.erase(path);
+        return nullptr;
+    }
+    if (s.entries.size() >= max_entries && s.entries.count(path) == 0)
+        s.entries.erase(s.entries.begin());
+    s.entries[path] = info;
+    return info;
+}
+
+void
+file_cache::
+    invalidate(std::string const &path)
+{
+    auto &s = shard_for(path);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.entries.erase(path);
+    ++s.generation;
+}
+
+void
+file_cache::
+    clear()
+{
+    for (auto &s : shards_)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.entries.clear();
+        ++s.generation;
+    }
+}
+
+void
+normalize_path(std::string &path)
+{
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < path.size(); ++i)
+    {
+        auto const c = path[i];
+        auto const after_separator = n != 0 && path[n - 1] == '/';
+        if (c == '/' && after_separator)
+            continue;
+        if (c == '.' && after_separator &&
+            (i + 1 == path.size() || path[i + 1] == '/'))
+            continue;
+        path[n++] = c;
+    }
+    path.resize(n);
+}
+
+bool
+etag_matches(boost::beast::string_view if_none_match, boost::beast::string_view etag) noexcept
+{
+    auto const trim = [](boost::beast::string_view v)
+    {
+        while (!v.empty() && (v.front() == ' ' || v.front() == '\t'))
+            v.remove_prefix(1);
+        while (!v.empty() && (v.back() == ' ' || v.back() == '\t'))
+            v.remove_suffix(1);
+        return v;
+    };
+
+    // A list of entity tags, or "*"
+    while (!if_none_match.empty())
+    {
+        auto const comma = if_none_match.find(',');
+        auto tag = trim(if_none_match.substr(0, comma));
+        if (tag == "*")
+            return true;
+        if (tag.starts_with("W/"))
+            tag.remove_prefix(2);
+        if (tag == etag)
+            return true;
+        if (comma == boost::beast::string_view::npos)
+            break;
+        if_none_match.remove_prefix(comma + 1);
+    }
+    return false;
+}
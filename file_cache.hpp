@@ -0,0 +1,102 @@
+#ifndef IR_WEBSOCKET_SERVER_FILE_CACHE_HPP
+#define IR_WEBSOCKET_SERVER_FILE_CACHE_HPP
+
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/string.hpp>
+#include <boost/optional.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// A precompressed sibling of a static file, "app.js.br" for "app.js"
+struct file_variant
+{
+    std::uint64_t size = 0;
+    std::string etag;
+};
+
+// What the server knows about a static file without opening it
+struct file_info
+{
+    std::uint64_t size = 0;
+    std::time_t mtime = 0;
+    std::string etag;           // strong, quoted, from inode, mtime and size
+    std::string last_modified;  // IMF-fixdate
+    std::chrono::steady_clock::time_point checked;
+
+    // Siblings at least as new as the file, older ones are ignored
+    boost::optional<file_variant> brotli;   // path + ".br"
+    boost::optional<file_variant> gzip;     // path + ".gz"
+};
+
+// File metadata by path, shared by all io threads.
+//
+// Entries are immutable and handed out by shared_ptr, so a reader
+// never holds a lock while it uses one. An entry older than the ttl
+// is checked again with stat() on its next lookup. The ttl is short
+// unless a file_watcher drops changed entries as they happen.
+class file_cache
+{
+    static constexpr std::size_t shard_count = 16;
+    static constexpr std::size_t max_entries = 4096; // per shard
+
+    struct shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<file_info const>> entries;
+
+        // Moved by every invalidation, so a lookup which ran stat()
+        // across one does not put back what it read before
+        std::uint64_t generation = 0;
+    };
+
+    std::array<shard, shard_count> shards_;
+    std::chrono::steady_clock::duration ttl_ = std::chrono::seconds(1);
+
+    shard &
+    shard_for(std::string const &path) noexcept
+    {
+        return shards_[std::hash<std::string>()(path) % shard_count];
+    }
+
+public:
+    // Return the metadata of a regular file, or set ec if it
+    // does not exist or cannot be read
+    std::shared_ptr<file_info const>
+    lookup(std::string const &path, boost::beast::error_code &ec);
+
+    // How long an entry is trusted without a stat(),
+    // set before the server starts
+    std::chrono::steady_clock::duration
+    ttl() const noexcept
+    {
+        return ttl_;
+    }
+
+    void
+    set_ttl(std::chrono::steady_clock::duration ttl) noexcept
+    {
+        ttl_ = ttl;
+    }
+
+    // Forget one path, or everything
+    void invalidate(std::string const &path);
+    void clear();
+};
+
+// Collapse repeated separators and "." segments in place, so that
+// a file has one key in the caches whichever way it was reached
+void
+normalize_path(std::string &path);
+
+// Returns true if an If-None-Match field value matches the entity tag,
+// using the weak comparison RFC 9110 requires for this field
+bool
+etag_matches(boost::beast::string_view if_none_match, boost::beast::string_view etag) noexcept;
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef IR_WEBSOCKET_SERVER_FILE_RANGE_BODY_HPP
+#define IR_WEBSOCKET_SERVER_FILE_RANGE_BODY_HPP
+
+#include "base.hpp"
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// An inclusive range of byte offsets
+struct byte_range
+{
+    std::uint64_t first;
+    std::uint64_t last;
+};
+
+enum class range_result
+{
+    ignore,         // no usable Range field, send the whole file
+    satisfiable,
+    unsatisfiable   // answer 416
+};
+
+// Parse a Range field value against a file of `size` bytes. Ranges
+// that overlap or touch are merged, and a field with more than
+// `max_ranges` ranges, or any syntax error, is ignored as RFC 9110
+// allows.
+inline range_result
+parse_range(
+    beast::string_view field,
+    std::uint64_t size,
+    std::vector<byte_range> &ranges,
+    std::size_t max_ranges = 16)
+{
+    ranges.clear();
+    beast::string_view const unit = "bytes=";
+    if (!beast::iequals(field.substr(0, unit.size()), unit))
+        return range_result::ignore;
+    field.remove_prefix(unit.size());
+
+    auto const number = [](beast::string_view s, std::uint64_t &v)
+    {
+        if (s.empty() || s.size() > 19)
+            return false;
+        v = 0;
+        for (auto c : s)
+        {
+            if (c < '0' || c > '9')
+                return false;
+            v = v * 10 + static_cast<unsigned>(c - '0');
+        }
+        return true;
+    };
+
+    bool any = false;
+    while (!field.empty())
+    {
+        auto const comma = field.find(',');
+        auto spec = field.substr(0, comma);
+        field.remove_prefix(comma == beast::string_view::npos ? field.size() : comma + 1);
+        while (!spec.empty() && (spec.front() == ' ' || spec.front() == '\t'))
+            spec.remove_prefix(1);
+        while (!spec.empty() && (spec.back() == ' ' || spec.back() == '\t'))
+            spec.remove_suffix(1);
+        if (spec.empty())
+            continue;
+
+        auto const dash = spec.find('-');
+        if (dash == beast::string_view::npos)
+            return range_result::ignore;
+        any = true;
+
+        std::uint64_t first, last;
+        if (dash == 0)
+        {
+            // The last n bytes
+            std::uint64_t n;
+            if (!number(spec.substr(1), n))
+                return range_result::ignore;
+            if (n == 0 || size == 0)
+                continue;
+            first = size - std::min(n, size);
+            last = size - 1;
+        }
+        else
+        {
+            if (!number(spec.substr(0, dash), first))
+                return range_result::ignore;
+            if (dash + 1 == spec.size())
+                last = size - 1;
+            else if (!number(spec.substr(dash + 1), last) || last < first)
+                return range_result::ignore;
+            if (first >= size)
+                continue;
+            last = std::min(last, size - 1);
+        }
+
+        if (ranges.size() == max_ranges)
+            return range_result::ignore;
+        ranges.push_back({first, last});
+    }
+
+    if (!any)
+        return range_result::ignore;
+    if (ranges.empty())
+        return range_result::unsatisfiable;
+
+    std::sort(ranges.begin(), ranges.end(),
+        [](byte_range const &a, byte_range const &b) { return a.first < b.first; });
+    std::size_t n = 0;
+    for (std::size_t i = 1; i < ranges.size(); ++i)
+    {
+        if (ranges[i].first <= ranges[n].last + 1)
+            ranges[n].last = std::max(ranges[n].last, ranges[i].last);
+        else
+            ranges[++n] = ranges[i];
+    }
+    ranges.resize(n + 1);
+    return range_result::satisfiable;
+}
+
+// A body of one or more byte ranges of an open file. Each part may
+// be preceded by its own header block, which is how a
+// multipart/byteranges body is laid out; a single range has none.
+struct file_range_body
+{
+    struct part
+    {
+        std::string head;
+        std::uint64_t offset;
+        std::uint64_t length;
+    };
+
+    struct value_type
+    {
+        beast::file file;
+        std::vector<part> parts;
+        std::string tail;
+
+        std::uint64_t
+        size() const noexcept
+        {
+            std::uint64_t n = tail.size();
+            for (auto const &p : parts)
+                n += p.head.size() + p.length;
+            return n;
+        }
+    };
+
+    static std::uint64_t
+    size(value_type const &body) noexcept
+    {
+        return body.size();
+    }
+
+    class writer
+    {
+        value_type &body_;
+        std::size_t part_ = 0;
+        bool head_done_ = false;
+        bool tail_done_ = false;
+        std::uint64_t done_ = 0;    // bytes of the current part sent
+        char buf_[4096];
+
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, class Fields>
+        writer(http::header<isRequest, Fields> &, value_type &body)
+            : body_(body)
+        {
+        }
+
+        void
+        init(beast::error_code &ec)
+        {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>>
+        get(beast::error_code &ec)
+        {
+            ec = {};
+            while (part_ < body_.parts.size())
+            {
+                auto const &p = body_.parts[part_];
+                if (!head_done_)
+                {
+                    head_done_ = true;
+                    body_.file.seek(p.offset, ec);
+                    if (ec)
+                        return boost::none;
+                    if (!p.head.empty())
+                        return {{net::buffer(p.head), true}};
+                }
+                if (done_ < p.length)
+                {
+                    auto const amount = static_cast<std::size_t>(
+                        std::min<std::uint64_t>(sizeof(buf_), p.length - done_));
+                    auto const n = body_.file.read(buf_, amount, ec);
+                    if (ec)
+                        return boost::none;
+                    if (n == 0)
+                    {
+                        // The file shrank after the ranges were checked
+                        ec = http::error::short_read;
+                        return boost::none;
+                    }
+                    done_ += n;
+                    return {{net::const_buffer(buf_, n), true}};
+                }
+                ++part_;
+                head_done_ = false;
+                done_ = 0;
+            }
+            if (!tail_done_ && !body_.tail.empty())
+            {
+                tail_done_ = true;
+                return {{net::buffer(body_.tail), false}};
+            }
+            return boost::none;
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "file_source.hpp"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+file_source::
+    file_source(net::thread_pool &pool, std::uint64_t size)
+    : pool_(pool.get_executor()), remaining_(size)
+{
+}
+
+file_source::
+    ~file_source()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+void
+file_source::
+    open(char const *path, beast::error_code &ec)
+{
+    fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+    {
+        ec.assign(errno, beast::system_category());
+        return;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    buffer_.reset(new char[std::min<std::uint64_t>(remaining_, chunk_size)]);
+    ec = {};
+}
+
+void
+file_source::
+    async_next(handler_type handler)
+{
+    if (remaining_ == 0)
+        return handler({}, {}, false);
+    auto const want = static_cast<std::size_t>(
+        std::min<std::uint64_t>(remaining_, chunk_size));
+
+#ifdef RWF_NOWAIT
+    // Try the page cache first
+    iovec iov{buffer_.get(), want};
+    auto const n = ::preadv2(fd_, &iov, 1, static_cast<off_t>(offset_), RWF_NOWAIT);
+    if (n >= 0)
+        return deliver({}, n, handler);
+    if (errno != EAGAIN && errno != EOPNOTSUPP && errno != ENOSYS && errno != EINVAL)
+        return deliver(beast::error_code(errno, beast::system_category()), 0, handler);
+#endif
+
+    // The handler only holds the session weakly, and the session
+    // owns this source, so the read holds the source itself
+    net::post(pool_,
+        [this, self = shared_from_this(), want, handler = std::move(handler)]
+        {
+            ssize_t n;
+            do
+                n = ::pread(fd_, buffer_.get(), want, static_cast<off_t>(offset_));
+            while (n < 0 && errno == EINTR);
+            if (n < 0)
+                return deliver(beast::error_code(errno, beast::system_category()), 0, handler);
+            deliver({}, n, handler);
+        });
+}
+
+void
+file_source::
+    deliver(beast::error_code ec, long n, handler_type const &handler)
+{
+    if (ec)
+        return handler(ec, {}, false);
+
+    // The file shrank after its size was sent
+    if (n == 0)
+        return handler(http::error::short_read, {}, false);
+
+    offset_ += static_cast<std::uint64_t>(n);
+    remaining_ -= static_cast<std::uint64_t>(n);
+    handler({}, net::const_buffer(buffer_.get(), static_cast<std::size_t>(n)), remaining_ > 0);
+}
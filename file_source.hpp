@@ -0,0 +1,43 @@
+#ifndef IR_WEBSOCKET_SERVER_FILE_SOURCE_HPP
+#define IR_WEBSOCKET_SERVER_FILE_SOURCE_HPP
+
+#include "body_source.hpp"
+#include <boost/asio/thread_pool.hpp>
+#include <cstdint>
+#include <memory>
+
+// Streams a file as the body of a response.
+//
+// A piece the page cache already holds is read on the io thread,
+// without blocking, with preadv2 and RWF_NOWAIT. Anything else is
+// read on the file thread pool, so a cold read stalls only the
+// session waiting for it and never the other sessions on its thread.
+class file_source
+    : public body_source,
+      public std::enable_shared_from_this<file_source>
+{
+    net::thread_pool::executor_type pool_;
+    int fd_ = -1;
+    std::uint64_t offset_ = 0;
+    std::uint64_t remaining_;
+    std::unique_ptr<char[]> buffer_;
+
+    void deliver(beast::error_code ec, long n, handler_type const &handler);
+
+public:
+    // Files smaller than this are sent by http::file_body, and
+    // those up to mapping_cache::max_size() from a mapping
+    static constexpr std::uint64_t min_size = 16 * 1024;
+
+    static constexpr std::size_t chunk_size = 64 * 1024;
+
+    // Send `size` bytes from the start of the file
+    file_source(net::thread_pool &pool, std::uint64_t size);
+    ~file_source();
+
+    void open(char const *path, beast::error_code &ec);
+
+    void async_next(handler_type handler) override;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "file_watcher.hpp"
+#include "logging.hpp"
+#include "shared_state.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+file_watcher::
+    file_watcher(shared_state &state)
+    : state_(state)
+{
+    // Paths are built the way path_cat builds them, so the
+    // invalidated keys are the ones the caches were filled with
+    root_ = state_.doc_root();
+    normalize_path(root_);
+    if (!root_.empty() && root_.back() == '/')
+        root_.resize(root_.size() - 1);
+}
+
+file_watcher::
+    ~file_watcher()
+{
+    stop();
+}
+
+#ifdef __linux__
+
+namespace {
+
+// Anything which can change what a path refers to. Plain writes are
+// left to IN_CLOSE_WRITE, so a file being written is dropped once
+// rather than once per write.
+constexpr std::uint32_t watch_events =
+    IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+} // namespace
+
+void
+file_watcher::
+    start(boost::beast::error_code &ec)
+{
+    fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0)
+    {
+        ec.assign(errno, boost::beast::system_category());
+        return;
+    }
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0)
+    {
+        ec.assign(errno, boost::beast::system_category());
+        ::close(fd_);
+        fd_ = -1;
+        return;
+    }
+
+    watch_tree(root_, ec);
+    if (ec)
+    {
+        ::close(fd_);
+        ::close(wake_fd_);
+        fd_ = wake_fd_ = -1;
+        dirs_.clear();
+        return;
+    }
+
+    FLEX_LOG(info, "file watcher: watching %zu directories", dirs_.size());
+    thread_ = std::thread([this] { run(); });
+}
+
+void
+file_watcher::
+    stop()
+{
+    if (thread_.joinable())
+    {
+        std::uint64_t const one = 1;
+        auto const written = ::write(wake_fd_, &one, sizeof(one));
+        (void)written;
+        thread_.join();
+    }
+    if (fd_ >= 0)
+        ::close(fd_);
+    if (wake_fd_ >= 0)
+        ::close(wake_fd_);
+    fd_ = wake_fd_ = -1;
+}
+
+void
+file_watcher::
+    watch_tree(std::string const &dir, boost::beast::error_code &ec)
+{
+    // Only doc_root itself may be a symbolic link
+    auto mask = watch_events | IN_ONLYDIR;
+    if (dir != root_)
+        mask |= IN_DONT_FOLLOW;
+    auto const wd = ::inotify_add_watch(fd_, dir.empty() ? "/" : dir.c_str(), mask);
+    if (wd < 0)
+    {
+        ec.assign(errno, boost::beast::system_category());
+        return;
+    }
+    dirs_[wd] = dir;
+
+    auto const d = ::opendir(dir.empty() ? "/" : dir.c_str());
+    if (!d)
+    {
+        ec.assign(errno, boost::beast::system_category());
+        return;
+    }
+    std::vector<std::string> children;
+    while (auto const e = ::readdir(d))
+    {
+        std::string const name = e->d_name;
+        if (name == "." || name == "..")
+            continue;
+        auto child = dir + "/" + name;
+        if (e->d_type == DT_UNKNOWN)
+        {
+            struct stat st;
+            if (::lstat(child.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+                continue;
+        }
+        else if (e->d_type != DT_DIR)
+            continue;
+        children.push_back(std::move(child));
+    }
+    ::closedir(d);
+
+    for (auto const &child : children)
+    {
+        watch_tree(child, ec);
+        if (ec)
+            return;
+    }
+}
+
+void
+file_watcher::
+    unwatch_tree(std::string const &dir)
+{
+    for (auto it = dirs_.begin(); it != dirs_.end();)
+    {
+        auto const &path = it->second;
+        if (path == dir ||
+            (path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 &&
+                path[dir.size()] == '/'))
+        {
+            ::inotify_rm_watch(fd_, it->first);
+            it = dirs_.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+void
+file_watcher::
+    run()
+{
+    alignas(inotify_event) char buf[64 * 1024];
+    pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+    for (;;)
+    {
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            FLEX_LOG(error, "file watcher: poll: %s", std::strerror(errno));
+            clear_caches();
+            return;
+        }
+        if (fds[1].revents != 0)
+            return;
+
+        for (;;)
+        {
+            auto const n = ::read(fd_, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+            for (auto p = buf; p < buf + n;)
+            {
+                auto const &ev = *reinterpret_cast<inotify_event const *>(p);
+                p += sizeof(inotify_event) + ev.len;
+
+                // Events were lost, anything may have changed
+                if (ev.mask & IN_Q_OVERFLOW)
+                {
+                    FLEX_LOG(warn, "file watcher: event queue overflowed, clearing caches");
+                    clear_caches();
+                    continue;
+                }
+
+                auto const it = dirs_.find(ev.wd);
+                if (it == dirs_.end())
+                    continue;
+                if (ev.mask & IN_IGNORED)
+                {
+                    dirs_.erase(it);
+                    continue;
+                }
+                if (ev.mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                {
+                    // Other directories are handled by their parent's event
+                    if (it->second == root_)
+                    {
+                        FLEX_LOG(warn, "file watcher: %s was moved or removed", root_.c_str());
+                        clear_caches();
+                    }
+                    continue;
+                }
+                if (ev.len == 0)
+                    continue;
+
+                auto path = it->second + "/" + ev.name;
+                if (!(ev.mask & IN_ISDIR))
+                {
+                    on_change(path);
+                    continue;
+                }
+
+                // A directory came, went or was renamed. The cached paths
+                // under an old name are dropped all at once, a new one has
+                // nothing cached yet but must be watched.
+                if (ev.mask & (IN_MOVED_FROM | IN_DELETE))
+                {
+                    unwatch_tree(path);
+                    clear_caches();
+                }
+                if (ev.mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    boost::beast::error_code ec;
+                    watch_tree(path, ec);
+                    if (ec)
+                        FLEX_LOG(warn, "file watcher: %s: %s", path.c_str(), ec.message().c_str());
+                    if (ev.mask & IN_MOVED_TO)
+                        clear_caches();
+                }
+            }
+        }
+    }
+}
+
+#else
+
+void
+file_watcher::
+    start(boost::beast::error_code &ec)
+{
+    ec = boost::beast::errc::make_error_code(boost::beast::errc::operation_not_supported);
+}
+
+void
+file_watcher::
+    stop()
+{
+}
+
+#endif
+
+void
+file_watcher::
+    on_change(std::string const &path)
+{
+    state_.files().invalidate(path);
+    state_.compressed().invalidate(path);
+    state_.mappings().invalidate(path);
+
+    // A sibling is part of the metadata of the file it compresses
+    auto const ends_with = [&path](char const *suffix)
+    {
+        return path.size() > 3 && path.compare(path.size() - 3, 3, suffix) == 0;
+    };
+    if (ends_with(".br") || ends_with(".gz"))
+        state_.files().invalidate(path.substr(0, path.size() - 3));
+}
+
+void
+file_watcher::
+    clear_caches()
+{
+    state_.files().clear();
+    state_.compressed().clear();
+    state_.mappings().clear();
+}
@@ -0,0 +1,52 @@
+#ifndef IR_WEBSOCKET_SERVER_FILE_WATCHER_HPP
+#define IR_WEBSOCKET_SERVER_FILE_WATCHER_HPP
+
+#include <boost/beast/core/error.hpp>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+class shared_state;
+
+// Keeps the file caches of a shared_state coherent with doc_root.
+//
+// A background thread watches every directory under doc_root with
+// inotify and drops the cached metadata, compressed copies and
+// mapping of a file as soon as it is written, replaced or removed,
+// so the caches can be trusted for much longer than a stat() per
+// request would allow. Symbolic links to directories are not followed, files
+// reached through them are only revalidated by the cache ttl. On
+// platforms without inotify start() fails and the ttl is all there is.
+class file_watcher
+{
+    shared_state &state_;
+    std::string root_;
+    int fd_ = -1;       // inotify
+    int wake_fd_ = -1;  // eventfd, signalled by stop()
+
+    // Watched directories by watch descriptor, only
+    // touched by the watcher thread once it runs
+    std::unordered_map<int, std::string> dirs_;
+    std::thread thread_;
+
+    void run();
+    void watch_tree(std::string const &dir, boost::beast::error_code &ec);
+    void unwatch_tree(std::string const &dir);
+    void on_change(std::string const &path);
+    void clear_caches();
+
+public:
+    explicit file_watcher(shared_state &state);
+    ~file_watcher();
+
+    file_watcher(file_watcher const &) = delete;
+    file_watcher &operator=(file_watcher const &) = delete;
+
+    // Watch doc_root and start the watcher thread
+    void start(boost::beast::error_code &ec);
+
+    // Stop the watcher thread, if it runs
+    void stop();
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef IR_WEBSOCKET_SERVER_HANDLER_ALLOCATOR_HPP
+#define IR_WEBSOCKET_SERVER_HANDLER_ALLOCATOR_HPP
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <array>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Recycled storage for the handlers of one chain of asynchronous
+// operations, such as the read loop of a session. Each block keeps
+// the largest size it has been asked for, so after the first few
+// operations the chain allocates nothing.
+//
+// Only operations of the same chain may share an instance: there is
+// no locking, which is safe because an operation's memory is always
+// released before the next operation in the chain is started.
+class handler_memory
+{
+    struct block
+    {
+        void* data = nullptr;
+        std::size_t size = 0;
+        bool in_use = false;
+    };
+
+    // Composed operations nest, e.g. an HTTP write inside an SSL write
+    // inside a socket write, so a chain needs a few live blocks at once
+    std::array<block, 4> blocks_;
+
+public:
+    handler_memory() = default;
+    handler_memory(handler_memory const&) = delete;
+    handler_memory& operator=(handler_memory const&) = delete;
+
+    ~handler_memory()
+    {
+        for(auto& b : blocks_)
+            ::operator delete(b.data);
+    }
+
+    void*
+    allocate(std::size_t size)
+    {
+        for(auto& b : blocks_)
+        {
+            if(! b.in_use && b.size >= size)
+            {
+                b.in_use = true;
+                return b.data;
+            }
+        }
+
+        // Grow a free block rather than falling back to the heap each time
+        for(auto& b : blocks_)
+        {
+            if(! b.in_use)
+            {
+                auto const data = ::operator new(size);
+                ::operator delete(b.data);
+                b.data = data;
+                b.size = size;
+                b.in_use = true;
+                return b.data;
+            }
+        }
+
+        return ::operator new(size);
+    }
+
+    void
+    deallocate(void* pointer) noexcept
+    {
+        for(auto& b : blocks_)
+        {
+            if(b.data == pointer)
+            {
+                b.in_use = false;
+                return;
+            }
+        }
+        ::operator delete(pointer);
+    }
+};
+
+// The allocator associated with handlers wrapped by custom_alloc_handler
+template<class T>
+class handler_allocator
+{
+    template<class U>
+    friend class handler_allocator;
+
+    handler_memory* memory_;
+
+public:
+    using value_type = T;
+
+    explicit
+    handler_allocator(handler_memory& memory) noexcept
+        : memory_(&memory)
+    {
+    }
+
+    template<class U>
+    handler_allocator(handler_allocator<U> const& other) noexcept
+        : memory_(other.memory_)
+    {
+    }
+
+    T*
+    allocate(std::size_t n)
+    {
+        return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+    }
+
+    void
+    deallocate(T* pointer, std::size_t) noexcept
+    {
+        memory_->deallocate(pointer);
+    }
+
+    template<class U>
+    friend bool
+    operator==(handler_allocator const& lhs, handler_allocator<U> const& rhs) noexcept
+    {
+        return lhs.memory_ == rhs.memory_;
+    }
+
+    template<class U>
+    friend bool
+    operator!=(handler_allocator const& lhs, handler_allocator<U> const& rhs) noexcept
+    {
+        return lhs.memory_ != rhs.memory_;
+    }
+};
+
+// Wraps a completion handler so that the operation which invokes
+// it allocates its state from a handler_memory
+template<class Handler>
+class custom_alloc_handler
+{
+    handler_memory* memory_;
+    Handler handler_;
+
+public:
+    using allocator_type = handler_allocator<Handler>;
+
+    custom_alloc_handler(handler_memory& memory, Handler handler)
+        : memory_(&memory)
+        , handler_(std::move(handler))
+    {
+    }
+
+    allocator_type
+    get_allocator() const noexcept
+    {
+        return allocator_type(*memory_);
+    }
+
+    Handler const&
+    handler() const noexcept
+    {
+        return handler_;
+    }
+
+    template<class... Args>
+    void
+    operator()(Args&&... args)
+    {
+        handler_(std::forward<Args>(args)...);
+    }
+};
+
+template<class Handler>
+custom_alloc_handler<typename std::decay<Handler>::type>
+make_custom_alloc_handler(handler_memory& memory, Handler&& handler)
+{
+    return {memory, std::forward<Handler>(handler)};
+}
+
+namespace boost {
+namespace asio {
+
+// Keep whatever executor the wrapped handler was bound to
+template<class Handler, class Executor>
+struct associated_executor<custom_alloc_handler<Handler>, Executor>
+{
+    using type = typename associated_executor<Handler, Executor>::type;
+
+    static type
+    get(custom_alloc_handler<Handler> const& h) noexcept
+    {
+        return associated_executor<Handler, Executor>::get(h.handler());
+    }
+
+    static type
+    get(custom_alloc_handler<Handler> const& h, Executor const& ex) noexcept
+    {
+        return associated_executor<Handler, Executor>::get(h.handler(), ex);
+    }
+};
+
+} // asio
+} // boost
+
+#endif
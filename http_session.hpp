@@ -1,6 +1,148 @@
 #include "base.hpp"
-#include <queue>
+#include "access_log.hpp"
+#include "arena.hpp"
+#include "body_source.hpp"
+#include "handler_allocator.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "ring_queue.hpp"
+#include "router.hpp"
+#include "session_pool.hpp"
 #include "shared_state.hpp"
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/container/static_vector.hpp>
+#include <algorithm>
+
+// Request header storage and bodies are drawn from the session arena
+using request_allocator = arena_allocator<char>;
+using request_body = http::basic_string_body<
+    char, std::char_traits<char>, request_allocator>;
+using request_type = http::request<request_body, http::basic_fields<request_allocator>>;
+
+// Copy a request header out of the session arena, so that it can
+// outlive the session, for example when it is handed to a WebSocket
+// session. An upgrade request has no body.
+template <class Allocator>
+http::request<http::string_body>
+detach_request(http::request_header<http::basic_fields<Allocator>> const &req)
+{
+    http::request<http::string_body> copy;
+    copy.method_string(req.method_string());
+    copy.target(req.target());
+    copy.version(req.version());
+    for (auto const &field : req)
+        copy.insert(field.name(), field.name_string(), field.value());
+    return copy;
+}
+
+// What the write loop knows about a response before sending it, read
+// from the buffers of its first prepare. The generator holds on to
+// prepared buffers until they are consumed, so peeking does not
+// disturb the write that follows.
+struct response_info
+{
+    unsigned status = 0;        // 0 if the status line is not available
+    std::size_t prepared = 0;   // bytes in the first prepared buffers
+    std::size_t header = 0;     // 0 if the header runs past them
+    boost::optional<std::uint64_t> content_length;
+
+    // The bytes the response puts on the wire. Exact when the header
+    // declares a Content-Length, except for responses to HEAD.
+    std::uint64_t
+    size() const noexcept
+    {
+        if (header != 0)
+            return header + content_length.value_or(prepared - header);
+        return prepared + content_length.value_or(0);
+    }
+
+    // True when the first prepare returned the entire response, so it
+    // can be gathered with others. A 204 or 304 has no body even
+    // without a Content-Length.
+    bool
+    whole() const noexcept
+    {
+        if (header == 0)
+            return false;
+        if (content_length)
+            return prepared == header + *content_length;
+        return (status == 204 || status == 304) && prepared == header;
+    }
+};
+
+// The serializer lays a header out as the status line, the reason,
+// "\r\n", one buffer per field and a final "\r\n", so the second bare
+// line ending marks the end of the header.
+inline response_info
+peek_response(http::message_generator &response)
+{
+    response_info info;
+    beast::error_code ec;
+    auto const buffers = response.prepare(ec);
+    if (ec)
+        return info;
+
+    int line_endings = 0;
+    for (auto const &buffer : buffers)
+    {
+        beast::string_view const data(
+            static_cast<char const *>(buffer.data()), buffer.size());
+        if (data.empty())
+            continue;
+        if (info.prepared == 0 && data.size() >= 12)
+            info.status = (data[9] - '0') * 100 + (data[10] - '0') * 10 + (data[11] - '0');
+        info.prepared += data.size();
+
+        if (info.header != 0)
+            continue;
+        if (data == "\r\n")
+        {
+            if (++line_endings == 2)
+                info.header = info.prepared;
+            continue;
+        }
+        beast::string_view const name = "Content-Length:";
+        if (line_endings == 1 && beast::iequals(data.substr(0, name.size()), name))
+        {
+            std::uint64_t n = 0;
+            for (auto c : data.substr(name.size()))
+                if (c >= '0' && c <= '9')
+                    n = n * 10 + static_cast<unsigned>(c - '0');
+            info.content_length = n;
+        }
+    }
+    return info;
+}
+
+// The same for a streamed response, from its header alone. The
+// size is the declared Content-Length, without the header.
+template <class Fields>
+response_info
+peek_streamed(http::response_header<Fields> const &header)
+{
+    response_info info;
+    info.status = header.result_int();
+    std::uint64_t n = 0;
+    auto const length = header[http::field::content_length];
+    for (auto c : length)
+        if (c >= '0' && c <= '9')
+            n = n * 10 + static_cast<unsigned>(c - '0');
+    if (!length.empty())
+        info.content_length = n;
+    return info;
+}
+
+// True for a read which failed on the body itself, such as a chunked
+// body over its route's limit. The request can still be answered,
+// unlike when the connection failed or the client went away.
+inline bool
+body_rejected(beast::error_code const &ec) noexcept
+{
+    return ec.category() == http::make_error_code(http::error::body_limit).category() &&
+        ec != http::error::end_of_stream &&
+        ec != http::error::partial_message;
+}
 
 // Handles an HTTP server connection.
 // This uses the Curiously Recurring Template Pattern so that
@@ -16,64 +158,198 @@ class HttpSessionManager
         return static_cast<HttpSession &>(*this);
     }
 
-    static constexpr std::size_t queue_limit = 8; // max responses
-    std::queue<http::message_generator> response_queue_;
-
-    // The parser is stored in an optional container so we can
-    // construct it from scratch it at the beginning of each new message.
-    boost::optional<http::request_parser<http::string_body>> parser_;
+    // A response waiting to be written, with the time its request was
+    // parsed and, when the access log is enabled, its partial log entry
+    struct pending_response
+    {
+        response_message message;
+        std::chrono::steady_clock::time_point received;
+        access_log::entry access{};
+        std::uint64_t size = 0;
+        bool whole = false;
+    };
+
+    // Pipelining. Reading stops while depth_ responses or more than
+    // shared_state::pipeline_bytes() are queued. The depth starts low,
+    // doubles each time a write completes while the client is held
+    // back by it, and halves when queued bytes were the limit instead.
+    // Nothing is read while a streamed response is queued, see streams_.
+    static constexpr std::size_t initial_depth = 4;
+    enum class paused
+    {
+        no,
+        depth,
+        bytes,
+        stream
+    };
+    ring_queue<pending_response, 32> response_queue_;
+    std::size_t depth_ = initial_depth;
+    std::uint64_t queued_bytes_ = 0;
+    paused paused_ = paused::no;
+
+    // Streamed responses in the queue. Each of their pieces is written
+    // under its own timeout, which a pending read's timer would not
+    // follow, so the next request is only read once they are out.
+    std::size_t streams_ = 0;
+
+    // Whole responses are written together, see do_write
+    static constexpr std::uint64_t max_gather_bytes = 64 * 1024;
+    boost::container::static_vector<net::const_buffer, 64> gather_;
+
+    // Writes the streamed response at the front of the queue
+    boost::optional<http::response_serializer<http::buffer_body, response_fields>> stream_;
+    std::uint64_t stream_bytes_ = 0;
+
+    // Holds the session while it writes a streamed response, see
+    // hold_stream. Its wait never expires, it is cancelled instead.
+    boost::optional<net::steady_timer> stream_hold_;
+    bool watching_ = false;
+
+    // Streamed request bodies are read this much at a time
+    static constexpr std::size_t chunk_size = 16 * 1024;
+
+    // Backs the parser's fields and body. It is rewound before each
+    // message, so it must be declared before the parser it outlives.
+    monotonic_arena arena_;
+
+    // The parsers are stored in optional containers so we can
+    // construct them from scratch at the beginning of each new message.
+    // The header is read first, then the route of the request decides
+    // whether the body is read into parser_ or streamed through
+    // stream_parser_ to a body_sink, a chunk at a time.
+    boost::optional<http::request_parser<http::empty_body, request_allocator>> header_parser_;
+    boost::optional<http::request_parser<request_body, request_allocator>> parser_;
+    boost::optional<http::request_parser<http::buffer_body, request_allocator>> stream_parser_;
+    body_plan plan_;
+    std::unique_ptr<char[]> chunk_;
     std::shared_ptr<shared_state> state_;
 
+    // The read and write loops run concurrently when pipelining,
+    // so each recycles its own handler memory
+    handler_memory read_memory_;
+    handler_memory write_memory_;
+
+    std::chrono::steady_clock::time_point read_started_;
+    std::uint64_t session_id_ = access_log::next_session_id();
+
 protected:
-    beast::flat_buffer buffer_;
+    session_buffer buffer_;
 
 public:
     // Construct the session
     HttpSessionManager(
-        beast::flat_buffer buffer,
+        session_buffer buffer,
         std::shared_ptr<shared_state> const &state)
         : buffer_(std::move(buffer)), state_(state)
     {
+        depth_ = std::min(depth_, max_depth());
+        metrics::add(metrics::gauge::http_sessions, 1);
+    }
+
+    ~HttpSessionManager()
+    {
+        metrics::add(metrics::gauge::http_sessions, -1);
+        metrics::add(
+            metrics::gauge::http_response_queue,
+            -static_cast<std::int64_t>(response_queue_.size()));
+    }
+
+    std::size_t
+    max_depth() const noexcept
+    {
+        return std::clamp<std::size_t>(
+            state_->pipeline_depth(), 1, response_queue_.capacity());
+    }
+
+    bool
+    can_read() const noexcept
+    {
+        return response_queue_.size() < depth_ &&
+            queued_bytes_ < state_->pipeline_bytes() &&
+            streams_ == 0;
     }
 
     void
     fail(beast::error_code ec, char const *what)
     {
-        std::cerr << what << ": " << ec.message() << "\n";
-
+        // A short read after a complete message is harmless,
+        // see the comment on fail() in listener.hpp
         if (ec == net::ssl::error::stream_truncated)
             return;
+
+        FLEX_LOG_LIMITED(warn, "http %s: %s", what, ec.message().c_str());
     }
 
     void
     do_read()
     {
-        // Construct a new parser for each message
-        parser_.emplace();
-
-        // Apply a reasonable limit to the allowed size
-        // of the body in bytes to prevent abuse.
-        parser_->body_limit(10000);
+        // Construct a new parser for each message. The previous request
+        // was consumed by handle_request, so the arena can be rewound.
+        parser_.reset();
+        stream_parser_.reset();
+        header_parser_.reset();
+        plan_ = {};
+        arena_.reset();
+        header_parser_.emplace(
+            std::piecewise_construct,
+            std::make_tuple(),
+            std::make_tuple(request_allocator(arena_)));
 
         // Set the timeout.
         beast::get_lowest_layer(
             httpSession().stream())
             .expires_after(std::chrono::seconds(30));
 
-        // Read a request using the parser-oriented interface
-        http::async_read(
+        // A pipelined request is already buffered. Otherwise wait for
+        // its first bytes, so that keep-alive idle time is not counted
+        // as reading the request.
+        if (buffer_.size() != 0)
+        {
+            read_started_ = std::chrono::steady_clock::now();
+            return do_read_header();
+        }
+
+        http::async_read_some(
             httpSession().stream(),
             buffer_,
-            *parser_,
-            beast::bind_front_handler(
-                &HttpSessionManager::on_read,
-                httpSession().shared_from_this()));
+            *header_parser_,
+            make_custom_alloc_handler(
+                read_memory_,
+                beast::bind_front_handler(
+                    &HttpSessionManager::on_first_bytes,
+                    httpSession().shared_from_this())));
     }
 
     void
-    on_read(beast::error_code ec, std::size_t bytes_transferred)
+    on_first_bytes(beast::error_code ec, std::size_t bytes_transferred)
     {
-        boost::ignore_unused(bytes_transferred);
+        read_started_ = std::chrono::steady_clock::now();
+        if (ec || header_parser_->is_header_done())
+            return on_read_header(ec, bytes_transferred);
+
+        metrics::add(metrics::counter::bytes_received, bytes_transferred);
+        do_read_header();
+    }
+
+    void
+    do_read_header()
+    {
+        // Read the header using the parser-oriented interface
+        http::async_read_header(
+            httpSession().stream(),
+            buffer_,
+            *header_parser_,
+            make_custom_alloc_handler(
+                read_memory_,
+                beast::bind_front_handler(
+                    &HttpSessionManager::on_read_header,
+                    httpSession().shared_from_this())));
+    }
+
+    void
+    on_read_header(beast::error_code ec, std::size_t bytes_transferred)
+    {
+        metrics::add(metrics::counter::bytes_received, bytes_transferred);
 
         // This means they closed the connection
         if (ec == http::error::end_of_stream)
@@ -82,33 +358,208 @@ public:
         if (ec)
             return fail(ec, "read");
 
+        auto &header = header_parser_->get();
+
         // See if it is a WebSocket Upgrade
-        if (websocket::is_upgrade(parser_->get()))
+        if (websocket::is_upgrade(header))
         {
             // Disable the timeout.
             // The websocket::stream uses its own timeout settings.
             beast::get_lowest_layer(httpSession().stream()).expires_never();
 
             // Create a websocket session, transferring ownership
-            // of both the socket and the HTTP request.
+            // of both the socket and the HTTP request. The request is
+            // copied out of the arena since this session is going away.
             return MakeWebsocketSession(
                 httpSession().release_stream(),
-                parser_->release(), state_);
+                detach_request(header), state_);
         }
 
-        // Send the response
-        queue_write(handle_request(state_->doc_root(), parser_->release()));
+        // Refuse a body larger than its route allows before reading
+        // any of it. The rest of the connection is unusable after.
+        plan_ = plan_body<request_type>(*state_, header);
+        auto const length = header_parser_->content_length();
+        if (length && *length > plan_.limit)
+        {
+            plan_.sink.reset();
+            plan_.ec = http::error::body_limit;
+        }
 
-        // If we aren't at the queue limit, try to pipeline another request
-        if (response_queue_.size() < queue_limit)
-            do_read();
+        if (plan_.sink || plan_.ec)
+        {
+            // A body which cannot be received is not read at all,
+            // so the connection cannot carry another request
+            if (plan_.ec)
+            {
+                if (!header_parser_->is_done())
+                    header.keep_alive(false);
+                return respond(request_type(std::move(header), request_allocator(arena_)));
+            }
+
+            stream_parser_.emplace(std::move(*header_parser_));
+            stream_parser_->body_limit(plan_.limit);
+            if (!chunk_)
+                chunk_.reset(new char[chunk_size]);
+            return do_read_body();
+        }
+
+        parser_.emplace(std::move(*header_parser_), request_allocator(arena_));
+
+        // Apply a reasonable limit to the allowed size
+        // of the body in bytes to prevent abuse.
+        parser_->body_limit(plan_.limit);
+        if (parser_->is_done())
+            return on_read({}, 0);
+
+        http::async_read(
+            httpSession().stream(),
+            buffer_,
+            *parser_,
+            make_custom_alloc_handler(
+                read_memory_,
+                beast::bind_front_handler(
+                    &HttpSessionManager::on_read,
+                    httpSession().shared_from_this())));
+    }
+
+    void
+    on_read(beast::error_code ec, std::size_t bytes_transferred)
+    {
+        metrics::add(metrics::counter::bytes_received, bytes_transferred);
+
+        if (ec && !body_rejected(ec))
+            return fail(ec, "read");
+
+        // Answer the header, the rest of the body is not read
+        if (ec)
+        {
+            plan_.ec = ec;
+            parser_->get().keep_alive(false);
+            return respond(request_type(std::move(parser_->get().base()), request_allocator(arena_)));
+        }
+
+        respond(parser_->release());
+    }
+
+    // Read the next chunk of a streamed body
+    void
+    do_read_body()
+    {
+        auto &body = stream_parser_->get().body();
+        body.data = chunk_.get();
+        body.size = chunk_size;
+
+        beast::get_lowest_layer(
+            httpSession().stream())
+            .expires_after(std::chrono::seconds(30));
+
+        http::async_read(
+            httpSession().stream(),
+            buffer_,
+            *stream_parser_,
+            make_custom_alloc_handler(
+                read_memory_,
+                beast::bind_front_handler(
+                    &HttpSessionManager::on_read_body,
+                    httpSession().shared_from_this())));
+    }
+
+    void
+    on_read_body(beast::error_code ec, std::size_t bytes_transferred)
+    {
+        metrics::add(metrics::counter::bytes_received, bytes_transferred);
+
+        // The chunk is full, not an error
+        if (ec == http::error::need_buffer)
+            ec = {};
+        if (ec && !body_rejected(ec))
+            return fail(ec, "read");
+
+        // Answered like a sink which failed
+        plan_.ec = ec;
+
+        auto &body = stream_parser_->get().body();
+        auto const n = chunk_size - body.size;
+        if (!plan_.ec && n > 0)
+            plan_.sink->write(net::const_buffer(chunk_.get(), n), plan_.ec);
+
+        if (!plan_.ec && !stream_parser_->is_done())
+            return do_read_body();
+
+        if (!plan_.ec)
+            plan_.sink->finish(plan_.ec);
+
+        // The rest of a body which failed is not read
+        if (plan_.ec)
+            stream_parser_->get().keep_alive(false);
+        respond(request_type(std::move(stream_parser_->get().base()), request_allocator(arena_)));
+    }
+
+    // Queue the response to a request whose body has been read, and
+    // read the next one unless the connection is to close after it
+    void
+    respond(request_type &&req)
+    {
+        auto const received = std::chrono::steady_clock::now();
+        metrics::record(metrics::stage::request_read, received - read_started_);
+
+        // Capture what the access log needs before the request is consumed
+        access_log::entry access{};
+        if (access_log::enabled())
+        {
+            access.method = static_cast<std::uint8_t>(req.method());
+            access.set_target(req.target());
+        }
+
+        // Send the response. The request is moved out so that its
+        // fields are gone before the arena is rewound for the next one.
+        // Either side may end the connection, an event stream closes
+        // it even when the client would keep it alive.
+        auto keep_alive = req.keep_alive();
+        auto response = handle_request(*state_, request_type(std::move(req)), std::move(plan_));
+        keep_alive = keep_alive && response.keep_alive();
+        metrics::record_since(metrics::stage::handle_request, received);
+        queue_write({std::move(response), received, access});
+        plan_ = {};
+
+        if (!keep_alive)
+            return;
+
+        // Read the next pipelined request if the queue has room
+        if (can_read())
+            return do_read();
+
+        if (streams_ != 0)
+        {
+            paused_ = paused::stream;
+        }
+        else if (queued_bytes_ >= state_->pipeline_bytes())
+        {
+            paused_ = paused::bytes;
+            depth_ = std::max<std::size_t>(depth_ / 2, 1);
+        }
+        else
+        {
+            paused_ = paused::depth;
+        }
     }
 
     void
-    queue_write(http::message_generator response)
+    queue_write(pending_response response)
     {
-        // Allocate and store the work
+        auto const info = response.message.streamed()
+            ? peek_streamed(response.message.header())
+            : peek_response(response.message.message());
+        response.access.status = static_cast<std::uint16_t>(info.status);
+        response.size = info.size();
+        response.whole = info.whole();
+        metrics::add_status(info.status);
+        if (response.message.streamed())
+            ++streams_;
+
+        queued_bytes_ += response.size;
         response_queue_.push(std::move(response));
+        metrics::add(metrics::gauge::http_response_queue, 1);
 
         // If there was no previous work, start the write loop
         if (response_queue_.size() == 1)
@@ -120,31 +571,249 @@ public:
     void
     do_write()
     {
-        if (!response_queue_.empty())
+        if (response_queue_.empty())
+            return;
+
+        // Send every whole response that is ready in one gathered
+        // write, up to a byte cap. The buffers stay valid until their
+        // generators are consumed or destroyed after the write.
+        gather_.clear();
+        std::size_t count = 0;
+        std::uint64_t bytes = 0;
+        bool keep_alive = true;
+        while (count < response_queue_.size() && keep_alive)
         {
-            bool keep_alive = response_queue_.front().keep_alive();
+            auto &response = response_queue_[count];
+            if (!response.whole ||
+                (count > 0 && bytes + response.size > max_gather_bytes))
+                break;
+
+            beast::error_code ec;
+            auto const buffers = response.message.message().prepare(ec);
+            if (ec || gather_.size() + buffers.size() > gather_.capacity())
+                break;
+            gather_.insert(gather_.end(), buffers.begin(), buffers.end());
+            bytes += response.size;
+            keep_alive = response.message.keep_alive();
+            ++count;
+        }
 
-            beast::async_write(
+        if (count > 0)
+        {
+            net::async_write(
                 httpSession().stream(),
-                std::move(response_queue_.front()),
+                beast::span<net::const_buffer const>(gather_.data(), gather_.size()),
+                make_custom_alloc_handler(
+                    write_memory_,
+                    beast::bind_front_handler(
+                        &HttpSessionManager::on_write,
+                        httpSession().shared_from_this(),
+                        count,
+                        keep_alive)));
+            return;
+        }
+
+        auto &front = response_queue_.front().message;
+        if (front.streamed())
+        {
+            stream_.emplace(front.header());
+            stream_bytes_ = 0;
+            hold_stream();
+            return do_stream();
+        }
+
+        // A response which does not fit its first prepared buffers
+        // is streamed on its own by the generator
+        keep_alive = front.keep_alive();
+
+        beast::async_write(
+            httpSession().stream(),
+            std::move(front.message()),
+            make_custom_alloc_handler(
+                write_memory_,
                 beast::bind_front_handler(
                     &HttpSessionManager::on_write,
                     httpSession().shared_from_this(),
-                    keep_alive));
+                    1,
+                    keep_alive)));
+    }
+
+    // The source of a streamed response holds the session weakly, an
+    // event stream keeps the handler until the next event and the
+    // session owns the source. So the session holds itself until the
+    // stream ends, with a wait which the io_context drops when it is
+    // destroyed. The socket is watched meanwhile: nothing is read from
+    // it, but a client which goes away is noticed without waiting for
+    // a write to fail.
+    void
+    hold_stream()
+    {
+        if (!stream_hold_)
+            stream_hold_.emplace(httpSession().stream().get_executor());
+        stream_hold_->expires_at(net::steady_timer::time_point::max());
+        stream_hold_->async_wait(
+            [self = httpSession().shared_from_this()](beast::error_code)
+            {
+            });
+
+        if (watching_)
+            return;
+        watching_ = true;
+        beast::get_lowest_layer(httpSession().stream()).socket().async_wait(
+            tcp::socket::wait_read,
+            [weak = std::weak_ptr<HttpSession>(httpSession().shared_from_this())](
+                beast::error_code ec)
+            {
+                if (auto self = weak.lock())
+                    self->on_watch(ec);
+            });
+    }
+
+    void
+    release_stream()
+    {
+        if (stream_hold_)
+            stream_hold_->cancel();
+    }
+
+    void
+    on_watch(beast::error_code ec)
+    {
+        watching_ = false;
+        if (ec || !stream_)
+            return;
+
+        // Readable with nothing to read means the client closed. Any
+        // data is a pipelined request, read once the stream is out.
+        auto &lowest = beast::get_lowest_layer(httpSession().stream());
+        if (lowest.socket().available(ec) != 0 && !ec)
+            return;
+        lowest.close();
+        release_stream();
+    }
+
+    // Ask the source of the streamed response for its next piece
+    void
+    do_stream()
+    {
+        response_queue_.front().message.source().async_next(
+            [weak = std::weak_ptr<HttpSession>(httpSession().shared_from_this())](
+                beast::error_code ec, net::const_buffer data, bool more)
+            {
+                auto self = weak.lock();
+                if (!self)
+                    return;
+
+                // The source may answer from another thread
+                net::dispatch(
+                    self->stream().get_executor(),
+                    [self, ec, data, more]
+                    {
+                        self->on_stream_data(ec, data, more);
+                    });
+            });
+    }
+
+    void
+    on_stream_data(beast::error_code ec, net::const_buffer data, bool more)
+    {
+        // Part of the response may be out already, so
+        // the only way to report this is to close
+        if (ec)
+        {
+            fail(ec, "stream");
+            beast::get_lowest_layer(httpSession().stream()).close();
+            release_stream();
+            return;
         }
+
+        auto &body = response_queue_.front().message.header().body();
+        body.data = data.size() != 0 ? const_cast<void *>(data.data()) : nullptr;
+        body.size = data.size();
+        body.more = more;
+
+        beast::get_lowest_layer(httpSession().stream())
+            .expires_after(std::chrono::seconds(30));
+        http::async_write(
+            httpSession().stream(),
+            *stream_,
+            make_custom_alloc_handler(
+                write_memory_,
+                beast::bind_front_handler(
+                    &HttpSessionManager::on_stream_write,
+                    httpSession().shared_from_this())));
     }
 
+    void
+    on_stream_write(beast::error_code ec, std::size_t bytes_transferred)
+    {
+        metrics::add(metrics::counter::bytes_sent, bytes_transferred);
+        stream_bytes_ += bytes_transferred;
+
+        // The piece is written and the serializer wants the next one
+        if (ec == http::error::need_buffer)
+            ec = {};
+        if (ec)
+        {
+            release_stream();
+            return fail(ec, "write");
+        }
+        if (!stream_->is_done())
+            return do_stream();
+
+        release_stream();
+        stream_.reset();
+        --streams_;
+        written(1, response_queue_.front().message.keep_alive(), stream_bytes_);
+    }
+
+    // Called when the first `count` responses in the queue have been written
     void
     on_write(
+        std::size_t count,
         bool keep_alive,
         beast::error_code ec,
         std::size_t bytes_transferred)
     {
-        boost::ignore_unused(bytes_transferred);
+        metrics::add(metrics::counter::bytes_sent, bytes_transferred);
 
         if (ec)
             return fail(ec, "write");
 
+        written(count, keep_alive, bytes_transferred);
+    }
+
+    void
+    written(std::size_t count, bool keep_alive, std::uint64_t bytes_transferred)
+    {
+        auto const written = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto &response = response_queue_.front();
+            metrics::record(
+                metrics::stage::time_to_first_byte,
+                written - response.received);
+
+            if (access_log::enabled())
+            {
+                auto &access = response.access;
+                access.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                access.session_id = session_id_;
+                access.bytes = count == 1 ? bytes_transferred : response.size;
+                access.latency_us = static_cast<std::uint32_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        written - response.received).count());
+                access.tls = HttpSession::secure;
+                access_log::push(access);
+            }
+
+            queued_bytes_ -= response.size;
+            response_queue_.pop();
+            metrics::add(metrics::gauge::http_response_queue, -1);
+        }
+
+        // A response asking to close ends the batch
         if (!keep_alive)
         {
             // This means we should close the connection, usually because
@@ -152,11 +821,17 @@ public:
             return httpSession().do_eof();
         }
 
+        // The client keeps up with the responses and has more
+        // requests waiting, so let it run further ahead
+        if (paused_ == paused::depth)
+            depth_ = std::min(depth_ * 2, max_depth());
+
         // Resume the read if it has been paused
-        if (response_queue_.size() == queue_limit)
+        if (paused_ != paused::no && can_read())
+        {
+            paused_ = paused::no;
             do_read();
-
-        response_queue_.pop();
+        }
 
         do_write();
     }
@@ -172,10 +847,12 @@ class PlainHttpSession
     beast::tcp_stream stream_;
 
 public:
+    static constexpr bool secure = false;
+
     // Create the session
     PlainHttpSession(
         beast::tcp_stream &&stream,
-        beast::flat_buffer &&buffer,
+        session_buffer &&buffer,
         std::shared_ptr<shared_state> const &&state)
         : HttpSessionManager<PlainHttpSession>(
               std::move(buffer),
@@ -225,13 +902,16 @@ class SSLHttpSession
       public std::enable_shared_from_this<SSLHttpSession>
 {
     beast::ssl_stream<beast::tcp_stream> stream_;
+    std::chrono::steady_clock::time_point handshake_started_;
 
 public:
+    static constexpr bool secure = true;
+
     // Create the HttpSessionManager
     SSLHttpSession(
         beast::tcp_stream &&stream,
         ssl::context &ctx,
-        beast::flat_buffer &&buffer,
+        session_buffer &&buffer,
         std::shared_ptr<shared_state> const &&state)
         : HttpSessionManager<SSLHttpSession>(
               std::move(buffer),
@@ -247,6 +927,8 @@ public:
         // Set the timeout.
         beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(30));
 
+        handshake_started_ = std::chrono::steady_clock::now();
+
         // Perform the SSL handshake
         // Note, this is the buffered version of the handshake.
         stream_.async_handshake(
@@ -294,10 +976,12 @@ private:
         if (ec)
             return fail(ec, "handshake");
 
+        metrics::record_since(metrics::stage::tls_handshake, handshake_started_);
+
         // Consume the portion of the buffer used by the handshake
         buffer_.consume(bytes_used);
 
-        std::cerr << "SSL handshake successful\n";
+        FLEX_LOG(debug, "SSL handshake successful");
 
         do_read();
     }
@@ -1,6 +1,10 @@
 #include "request_handler.hpp"
 #include "websocket_session.hpp"
 #include "http_session.hpp"
+#include "handler_allocator.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "session_pool.hpp"
 #include "shared_state.hpp"
 #include <boost/asio/bind_executor.hpp>
 #include <boost/asio/dispatch.hpp>
@@ -40,7 +44,7 @@ fail(beast::error_code ec, char const* what)
     if(ec == net::ssl::error::stream_truncated)
         return;
 
-    std::cerr << what << ": " << ec.message() << "\n";
+    FLEX_LOG_LIMITED(warn, "%s: %s", what, ec.message().c_str());
 }
 
 // Detects SSL handshakes
@@ -49,7 +53,8 @@ class detect_session : public std::enable_shared_from_this<detect_session>
     beast::tcp_stream stream_;
     ssl::context& ctx_;
     std::shared_ptr<shared_state> state_;
-    beast::flat_buffer buffer_;
+    session_buffer buffer_;
+    std::chrono::steady_clock::time_point accepted_;
 
 public:
     explicit
@@ -60,7 +65,11 @@ public:
         : stream_(std::move(socket))
         , ctx_(ctx)
         , state_(std::move(state))
+        , accepted_(std::chrono::steady_clock::now())
     {
+        // The buffer moves on to the HTTP session, so
+        // size it once for the request headers too
+        buffer_.reserve(session_buffer_size);
     }
 
     // Launch the detector
@@ -98,10 +107,15 @@ public:
         if(ec)
             return fail(ec, "detect");
 
+        metrics::record_since(metrics::stage::accept_to_detect, accepted_);
+        metrics::add(result
+            ? metrics::counter::tls_connections
+            : metrics::counter::plain_connections);
+
         if(result)
         {
             // Launch SSL session
-            std::make_shared<SSLHttpSession>(
+            make_pooled_session<SSLHttpSession>(
                 std::move(stream_),
                 ctx_,
                 std::move(buffer_),
@@ -110,7 +124,7 @@ public:
         }
 
         // Launch plain session
-        std::make_shared<PlainHttpSession>(
+        make_pooled_session<PlainHttpSession>(
             std::move(stream_),
             std::move(buffer_),
             std::move(state_))->run();
@@ -124,6 +138,7 @@ class listener : public std::enable_shared_from_this<listener>
     ssl::context& ctx_;
     tcp::acceptor acceptor_;
     const std::shared_ptr<shared_state> state_;
+    handler_memory accept_memory_;
 
 public:
     listener(
@@ -172,6 +187,14 @@ public:
         }
     }
 
+    // The bound address, useful when listening on port 0
+    tcp::endpoint
+    local_endpoint() const
+    {
+        beast::error_code ec;
+        return acceptor_.local_endpoint(ec);
+    }
+
     // Start accepting incoming connections
     void
     run()
@@ -186,9 +209,11 @@ private:
         // The new connection gets its own strand
         acceptor_.async_accept(
             net::make_strand(ioc_),
-            beast::bind_front_handler(
-                &listener::on_accept,
-                shared_from_this()));
+            make_custom_alloc_handler(
+                accept_memory_,
+                beast::bind_front_handler(
+                    &listener::on_accept,
+                    shared_from_this())));
     }
 
     void
@@ -196,12 +221,15 @@ private:
     {
         if(ec)
         {
+            metrics::add(metrics::counter::accept_errors);
             fail(ec, "accept");
         }
         else
         {
+            metrics::add(metrics::counter::accepts);
+
             // Create the detector http_session and run it
-            std::make_shared<detect_session>(
+            make_pooled_session<detect_session>(
                 std::move(socket),
                 ctx_,
                 std::move(state_))->run();
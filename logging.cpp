@@ -0,0 +1,239 @@
+#include "logging.hpp"
+#include "spsc_ring.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace logging {
+
+std::atomic<int> current_level{static_cast<int>(level::info)};
+
+namespace {
+
+struct record
+{
+    std::int64_t time_ns;
+    level lvl;
+    std::uint32_t suppressed;
+    std::uint16_t size;
+    char text[236];
+};
+
+static_assert(sizeof(record) == 256, "keep records to four cache lines");
+
+struct thread_ring
+{
+    spsc_ring<record, 512> ring;
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<bool> closed{false};
+};
+
+class writer
+{
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::shared_ptr<thread_ring>> rings_;
+    bool stop_ = false;
+    std::thread thread_;
+
+    static void
+    format(std::string& out, record const& r)
+    {
+        static char const* const names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR"};
+
+        auto const seconds = static_cast<std::time_t>(r.time_ns / 1000000000);
+        std::tm tm{};
+        gmtime_r(&seconds, &tm);
+        char prefix[64];
+        auto n = std::strftime(prefix, sizeof(prefix), "%Y-%m-%dT%H:%M:%S", &tm);
+        std::snprintf(prefix + n, sizeof(prefix) - n, ".%03dZ %-5s ",
+            static_cast<int>(r.time_ns / 1000000 % 1000),
+            names[static_cast<int>(r.lvl)]);
+        out.append(prefix);
+        out.append(r.text, r.size);
+        if(r.suppressed)
+            out.append(" (").append(std::to_string(r.suppressed)).append(" similar suppressed)");
+        out.push_back('\n');
+    }
+
+    // Drain every ring once, returns the number of records written
+    std::size_t
+    drain(std::string& out)
+    {
+        std::vector<std::shared_ptr<thread_ring>> rings;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            rings = rings_;
+        }
+
+        std::size_t n = 0;
+        for(auto const& r : rings)
+        {
+            n += r->ring.drain([&](record const& rec) { format(out, rec); });
+            if(auto const dropped = r->dropped.exchange(0, std::memory_order_relaxed))
+                out.append("log: ").append(std::to_string(dropped)).append(" records dropped\n");
+        }
+        if(! out.empty())
+        {
+            std::fwrite(out.data(), 1, out.size(), stderr);
+            std::fflush(stderr);
+            out.clear();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Forget rings of threads which have exited once they are empty
+        rings_.erase(
+            std::remove_if(rings_.begin(), rings_.end(),
+                [](std::shared_ptr<thread_ring> const& r)
+                {
+                    return r->closed.load(std::memory_order_acquire) && r->ring.empty();
+                }),
+            rings_.end());
+        cv_.notify_all();
+        return n;
+    }
+
+    void
+    run()
+    {
+        std::string out;
+        out.reserve(64 * 1024);
+        auto idle = std::chrono::milliseconds(1);
+        for(;;)
+        {
+            if(drain(out) > 0)
+            {
+                idle = std::chrono::milliseconds(1);
+                continue;
+            }
+
+            // Back off while idle, producers never signal
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(stop_)
+                break;
+            cv_.wait_for(lock, idle);
+            idle = std::min(idle * 2, std::chrono::milliseconds(50));
+        }
+        drain(out);
+    }
+
+public:
+    writer()
+        : thread_([this] { run(); })
+    {
+    }
+
+    ~writer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    std::shared_ptr<thread_ring>
+    add_ring()
+    {
+        auto r = std::make_shared<thread_ring>();
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(r);
+        return r;
+    }
+
+    void
+    flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto const rings = rings_;
+        cv_.notify_all();
+        cv_.wait(lock, [&]
+        {
+            for(auto const& r : rings)
+                if(! r->ring.empty())
+                    return false;
+            return true;
+        });
+    }
+};
+
+writer&
+get_writer()
+{
+    static writer w;
+    return w;
+}
+
+struct ring_handle
+{
+    std::shared_ptr<thread_ring> ring = get_writer().add_ring();
+
+    ~ring_handle()
+    {
+        ring->closed.store(true, std::memory_order_release);
+    }
+};
+
+thread_ring&
+local_ring()
+{
+    thread_local ring_handle handle;
+    return *handle.ring;
+}
+
+} // namespace
+
+bool
+parse_level(char const* name, level& lvl) noexcept
+{
+    static char const* const names[] = {"trace", "debug", "info", "warn", "error", "off"};
+    for(int i = 0; i <= static_cast<int>(level::off); ++i)
+    {
+        if(std::strcmp(name, names[i]) == 0)
+        {
+            lvl = static_cast<level>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+write(level lvl, std::uint32_t suppressed, char const* format, ...) noexcept
+{
+    auto const time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    auto& r = local_ring();
+    std::va_list args;
+    va_start(args, format);
+    auto const pushed = r.ring.try_push([&](record& rec)
+    {
+        rec.time_ns = time_ns;
+        rec.lvl = lvl;
+        rec.suppressed = suppressed;
+        auto const n = std::vsnprintf(rec.text, sizeof(rec.text), format, args);
+        rec.size = static_cast<std::uint16_t>(
+            n < 0 ? 0 : std::min<std::size_t>(static_cast<std::size_t>(n), sizeof(rec.text) - 1));
+    });
+    va_end(args);
+    if(! pushed)
+        r.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+flush() noexcept
+{
+    get_writer().flush();
+}
+
+} // logging
@@ -0,0 +1,119 @@
+#ifndef IR_WEBSOCKET_SERVER_LOGGING_HPP
+#define IR_WEBSOCKET_SERVER_LOGGING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Levels below this are compiled out entirely.
+// 0 trace, 1 debug, 2 info, 3 warn, 4 error
+#ifndef FLEX_LOG_MIN_LEVEL
+#define FLEX_LOG_MIN_LEVEL 1
+#endif
+
+// An asynchronous logger for the io threads.
+//
+// Each thread formats its records into a private ring which a
+// background thread drains and writes to stderr in batches, so
+// logging never takes a lock or waits on the terminal. When a ring
+// is full the record is dropped and counted rather than blocking.
+namespace logging {
+
+enum class level : int
+{
+    trace,
+    debug,
+    info,
+    warn,
+    error,
+    off
+};
+
+// The runtime level, records below it are skipped before formatting
+extern std::atomic<int> current_level;
+
+inline bool
+enabled(level lvl) noexcept
+{
+    return static_cast<int>(lvl) >= current_level.load(std::memory_order_relaxed);
+}
+
+inline void
+set_level(level lvl) noexcept
+{
+    current_level.store(static_cast<int>(lvl), std::memory_order_relaxed);
+}
+
+// Parse "trace", "debug", "info", "warn", "error" or "off"
+bool parse_level(char const* name, level& lvl) noexcept;
+
+// Format a record into the calling thread's ring. `suppressed` is the
+// number of similar records a rate limit dropped before this one.
+void write(level lvl, std::uint32_t suppressed, char const* format, ...) noexcept
+#if defined(__GNUC__)
+    __attribute__((format(printf, 3, 4)))
+#endif
+    ;
+
+// Block until every record written so far has reached stderr
+void flush() noexcept;
+
+// Allows a burst of records per second from one call site and
+// counts the rest, so a storm of identical errors costs little
+class rate_limit
+{
+    static constexpr std::uint32_t burst = 10;
+
+    std::atomic<std::int64_t> window_{0};
+    std::atomic<std::uint32_t> count_{0};
+    std::atomic<std::uint32_t> suppressed_{0};
+
+public:
+    bool
+    allow(std::uint32_t& suppressed) noexcept
+    {
+        auto const now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        auto window = window_.load(std::memory_order_relaxed);
+        if(now != window && window_.compare_exchange_strong(window, now))
+            count_.store(0, std::memory_order_relaxed);
+        if(count_.fetch_add(1, std::memory_order_relaxed) >= burst)
+        {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+} // logging
+
+#define FLEX_LOG(lvl, ...)                                                  \
+    do                                                                      \
+    {                                                                       \
+        if constexpr(static_cast<int>(::logging::level::lvl) >=             \
+            FLEX_LOG_MIN_LEVEL)                                             \
+        {                                                                   \
+            if(::logging::enabled(::logging::level::lvl))                   \
+                ::logging::write(::logging::level::lvl, 0, __VA_ARGS__);    \
+        }                                                                   \
+    } while(false)
+
+// Like FLEX_LOG, limited to a burst per second from this call site
+#define FLEX_LOG_LIMITED(lvl, ...)                                          \
+    do                                                                      \
+    {                                                                       \
+        if constexpr(static_cast<int>(::logging::level::lvl) >=             \
+            FLEX_LOG_MIN_LEVEL)                                             \
+        {                                                                   \
+            static ::logging::rate_limit flex_log_limit_;                   \
+            std::uint32_t flex_log_suppressed_ = 0;                         \
+            if(::logging::enabled(::logging::level::lvl) &&                 \
+                flex_log_limit_.allow(flex_log_suppressed_))                \
+                ::logging::write(::logging::level::lvl,                     \
+                    flex_log_suppressed_, __VA_ARGS__);                     \
+        }                                                                   \
+    } while(false)
+
+#endif
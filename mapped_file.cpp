@@ -0,0 +1,117 @@
+#include "mapped_file.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file::
+    ~mapped_file()
+{
+    if (data_)
+        ::munmap(data_, size_);
+}
+
+std::shared_ptr<mapped_file const>
+mapped_file::
+    map(char const *path, std::uint64_t size, beast::error_code &ec)
+{
+    auto const fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        ec.assign(errno, beast::system_category());
+        return nullptr;
+    }
+
+    // The size must match what the response declares
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::uint64_t>(st.st_size) != size || size == 0)
+    {
+        ec = http::error::short_read;
+        ::close(fd);
+        return nullptr;
+    }
+
+    auto const data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    auto const error = errno;
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        ec.assign(error, beast::system_category());
+        return nullptr;
+    }
+
+    // Read ahead now, the whole mapping is sent front to back
+    ::madvise(data, size, MADV_SEQUENTIAL);
+    ::madvise(data, size, MADV_WILLNEED);
+
+    std::shared_ptr<mapped_file> file(new mapped_file);
+    file->data_ = data;
+    file->size_ = static_cast<std::size_t>(size);
+    ec = {};
+    return file;
+}
+
+std::shared_ptr<mapped_file const>
+mapping_cache::
+    get(std::string const &path, std::string const &etag, std::uint64_t size,
+        beast::error_code &ec)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto const it = index_.find(path);
+        if (it != index_.end() && it->second->etag == etag)
+        {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            ec = {};
+            return it->second->file;
+        }
+    }
+
+    // Map outside the lock, a racing miss at worst maps twice
+    auto file = mapped_file::map(path.c_str(), size, ec);
+    if (ec)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = index_.find(path);
+    if (it != index_.end())
+    {
+        bytes_ -= it->second->file->size();
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    lru_.push_front({path, etag, file});
+    index_.emplace(path, lru_.begin());
+    bytes_ += file->size();
+    while (bytes_ > capacity_ && lru_.size() > 1)
+    {
+        bytes_ -= lru_.back().file->size();
+        index_.erase(lru_.back().path);
+        lru_.pop_back();
+    }
+    return file;
+}
+
+void
+mapping_cache::
+    invalidate(std::string const &path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = index_.find(path);
+    if (it == index_.end())
+        return;
+    bytes_ -= it->second->file->size();
+    lru_.erase(it->second);
+    index_.erase(it);
+}
+
+void
+mapping_cache::
+    clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
@@ -0,0 +1,147 @@
+#ifndef IR_WEBSOCKET_SERVER_MAPPED_FILE_HPP
+#define IR_WEBSOCKET_SERVER_MAPPED_FILE_HPP
+
+#include "base.hpp"
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// A read-only mapping of a whole file, unmapped when the last
+// response using it is gone.
+//
+// Shrinking a file in place while it is mapped makes reads past its
+// new end fault with SIGBUS, so this is only safe for files which are
+// replaced by rename. Mapping is off unless --mmap-max turns it on.
+class mapped_file
+{
+    void *data_ = nullptr;
+    std::size_t size_ = 0;
+
+    mapped_file() = default;
+
+public:
+    ~mapped_file();
+
+    mapped_file(mapped_file const &) = delete;
+    mapped_file &operator=(mapped_file const &) = delete;
+
+    // Map `size` bytes of the file, failing if it is not that size
+    static std::shared_ptr<mapped_file const>
+    map(char const *path, std::uint64_t size, beast::error_code &ec);
+
+    net::const_buffer
+    buffer() const noexcept
+    {
+        return {data_, size_};
+    }
+
+    std::size_t
+    size() const noexcept
+    {
+        return size_;
+    }
+};
+
+// A body sent straight from a mapping. The serializer hands the whole
+// mapping to the socket in one buffer, so nothing is copied and the
+// response can be gathered with others.
+struct mapped_body
+{
+    using value_type = std::shared_ptr<mapped_file const>;
+
+    static std::uint64_t
+    size(value_type const &body) noexcept
+    {
+        return body ? body->size() : 0;
+    }
+
+    class writer
+    {
+        value_type const &body_;
+
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, class Fields>
+        writer(http::header<isRequest, Fields> const &, value_type const &body)
+            : body_(body)
+        {
+        }
+
+        void
+        init(beast::error_code &ec)
+        {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>>
+        get(beast::error_code &ec)
+        {
+            ec = {};
+            if (!body_)
+                return boost::none;
+            return {{body_->buffer(), false}};
+        }
+    };
+};
+
+// Mappings of mid-sized static files by path, shared by every
+// response for the same version of a file. The least recently used
+// are dropped once the mapped total passes the capacity, a response
+// still holding one keeps it mapped until it is written.
+class mapping_cache
+{
+public:
+    // Smaller files are read, a mapping costs at least a page
+    static constexpr std::uint64_t min_size = 16 * 1024;
+
+    explicit mapping_cache(std::uint64_t capacity = 256 * 1024 * 1024)
+        : capacity_(capacity)
+    {
+    }
+
+    // Larger files are streamed, 0 (the default) turns mapping off.
+    // Set before the server starts.
+    std::uint64_t
+    max_size() const noexcept
+    {
+        return max_size_;
+    }
+
+    void
+    set_max_size(std::uint64_t size) noexcept
+    {
+        max_size_ = size;
+    }
+
+    // Return the mapping of this version of a file, mapping it on a miss
+    std::shared_ptr<mapped_file const>
+    get(std::string const &path, std::string const &etag, std::uint64_t size,
+        beast::error_code &ec);
+
+    // Forget the mapping of one file, or all of them
+    void invalidate(std::string const &path);
+    void clear();
+
+private:
+    struct entry
+    {
+        std::string path;
+        std::string etag;
+        std::shared_ptr<mapped_file const> file;
+    };
+
+    std::mutex mutex_;
+    std::list<entry> lru_;  // most recently used first
+    std::unordered_map<std::string, std::list<entry>::iterator> index_;
+    std::uint64_t bytes_ = 0;
+    std::uint64_t capacity_;
+    std::uint64_t max_size_ = 0;
+};
+
+#endif
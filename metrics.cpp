@@ -0,0 +1,237 @@
+#include "metrics.hpp"
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace metrics {
+
+namespace {
+
+struct registry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<block>> blocks;
+};
+
+registry&
+get_registry()
+{
+    static registry r;
+    return r;
+}
+
+struct descriptor
+{
+    char const* family;
+    char const* labels;
+    char const* help;
+};
+
+// Indexed by counter, members of a family must be adjacent
+descriptor const counters[] = {
+    {"flex_accepts_total", "", "Connections accepted"},
+    {"flex_accept_errors_total", "", "Failed accepts"},
+    {"flex_connections_total", "transport=\"tls\"", "Connections by detected transport"},
+    {"flex_connections_total", "transport=\"plain\"", nullptr},
+    {"flex_http_responses_total", "code=\"1xx\"", "HTTP responses by status class"},
+    {"flex_http_responses_total", "code=\"2xx\"", nullptr},
+    {"flex_http_responses_total", "code=\"3xx\"", nullptr},
+    {"flex_http_responses_total", "code=\"4xx\"", nullptr},
+    {"flex_http_responses_total", "code=\"5xx\"", nullptr},
+    {"flex_received_bytes_total", "", "Bytes read from HTTP and WebSocket sessions"},
+    {"flex_sent_bytes_total", "", "Bytes written to HTTP and WebSocket sessions"},
+    {"flex_jwt_verifications_total", "result=\"ok\"", "Access token verifications, for WebSocket upgrades and broadcasts"},
+    {"flex_jwt_verifications_total", "result=\"failed\"", nullptr},
+    {"flex_jwt_verifications_total", "result=\"revoked\"", nullptr},
+    {"flex_access_log_dropped_total", "", "Access log entries dropped because a ring was full"},
+    {"flex_broadcast_dropped_total", "", "Broadcasts dropped for subscribers too far behind"},
+};
+
+static_assert(
+    sizeof(counters) / sizeof(counters[0]) == static_cast<std::size_t>(counter::count_),
+    "every counter needs a descriptor");
+
+// Indexed by gauge
+descriptor const gauges[] = {
+    {"flex_http_sessions", "", "Open HTTP sessions"},
+    {"flex_websocket_sessions", "", "Open WebSocket sessions"},
+    {"flex_http_response_queue_depth", "", "Pipelined HTTP responses waiting to be written"},
+    {"flex_event_streams", "", "Open text/event-stream responses"},
+};
+
+static_assert(
+    sizeof(gauges) / sizeof(gauges[0]) == static_cast<std::size_t>(gauge::count_),
+    "every gauge needs a descriptor");
+
+// Indexed by stage
+char const* const stages[] = {
+    "accept_to_detect",
+    "tls_handshake",
+    "request_read",
+    "handle_request",
+    "time_to_first_byte",
+    "websocket_upgrade",
+    "websocket_message",
+};
+
+static_assert(
+    sizeof(stages) / sizeof(stages[0]) == static_cast<std::size_t>(stage::count_),
+    "every stage needs a name");
+
+struct latency_totals
+{
+    std::uint64_t sum[static_cast<std::size_t>(stage::count_)] = {};
+    std::uint64_t buckets[static_cast<std::size_t>(stage::count_)][histogram::bucket_count] = {};
+};
+
+std::unique_ptr<latency_totals>
+merge_latencies()
+{
+    auto totals = std::make_unique<latency_totals>();
+    auto& r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for(auto const& b : r.blocks)
+    {
+        for(std::size_t i = 0; i < static_cast<std::size_t>(stage::count_); ++i)
+        {
+            totals->sum[i] += b->latency_sum[i].load(std::memory_order_relaxed);
+            for(std::size_t j = 0; j < histogram::bucket_count; ++j)
+                totals->buckets[i][j] += b->latency[i][j].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+std::string
+format_seconds(std::uint64_t ns)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", static_cast<double>(ns) / 1e9);
+    return buf;
+}
+
+void
+append_sample(
+    std::string& out,
+    descriptor const& d,
+    char const* type,
+    std::string const& value)
+{
+    if(d.help)
+    {
+        out.append("# HELP ").append(d.family).append(" ").append(d.help).append("\n");
+        out.append("# TYPE ").append(d.family).append(" ").append(type).append("\n");
+    }
+    out.append(d.family);
+    if(*d.labels)
+        out.append("{").append(d.labels).append("}");
+    out.append(" ").append(value).append("\n");
+}
+
+} // namespace
+
+block&
+register_block()
+{
+    auto& r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.blocks.push_back(std::make_unique<block>());
+    return *r.blocks.back();
+}
+
+std::string
+scrape()
+{
+    std::uint64_t counter_totals[static_cast<std::size_t>(counter::count_)] = {};
+    std::int64_t gauge_totals[static_cast<std::size_t>(gauge::count_)] = {};
+    {
+        auto& r = get_registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for(auto const& b : r.blocks)
+        {
+            for(std::size_t i = 0; i < static_cast<std::size_t>(counter::count_); ++i)
+                counter_totals[i] += b->counters[i].load(std::memory_order_relaxed);
+            for(std::size_t i = 0; i < static_cast<std::size_t>(gauge::count_); ++i)
+                gauge_totals[i] += b->gauges[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    std::string out;
+    out.reserve(4096);
+    for(std::size_t i = 0; i < static_cast<std::size_t>(counter::count_); ++i)
+        append_sample(out, counters[i], "counter", std::to_string(counter_totals[i]));
+    for(std::size_t i = 0; i < static_cast<std::size_t>(gauge::count_); ++i)
+        append_sample(out, gauges[i], "gauge", std::to_string(gauge_totals[i]));
+
+    // Histogram buckets are reported at every power of two from about
+    // 1us, coarser than recorded, to keep the scrape a reasonable size
+    auto const latencies = merge_latencies();
+    out.append("# HELP flex_stage_duration_seconds Latency of request and message handling stages\n");
+    out.append("# TYPE flex_stage_duration_seconds histogram\n");
+    for(std::size_t i = 0; i < static_cast<std::size_t>(stage::count_); ++i)
+    {
+        std::string const labels = std::string("stage=\"") + stages[i] + "\"";
+        std::uint64_t cumulative = 0;
+        std::size_t bucket = 0;
+        for(unsigned exponent = 10; exponent <= histogram::max_exponent; ++exponent)
+        {
+            auto const limit = std::size_t{exponent - histogram::sub_bits + 1} << histogram::sub_bits;
+            for(; bucket < limit; ++bucket)
+                cumulative += latencies->buckets[i][bucket];
+            out.append("flex_stage_duration_seconds_bucket{").append(labels)
+               .append(",le=\"").append(format_seconds(std::uint64_t{1} << exponent))
+               .append("\"} ").append(std::to_string(cumulative)).append("\n");
+        }
+        out.append("flex_stage_duration_seconds_bucket{").append(labels)
+           .append(",le=\"+Inf\"} ").append(std::to_string(cumulative)).append("\n");
+        out.append("flex_stage_duration_seconds_sum{").append(labels).append("} ")
+           .append(format_seconds(latencies->sum[i])).append("\n");
+        out.append("flex_stage_duration_seconds_count{").append(labels).append("} ")
+           .append(std::to_string(cumulative)).append("\n");
+    }
+    return out;
+}
+
+std::string
+latency_summary()
+{
+    double constexpr quantiles[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+    char const* const names[] = {"p50", "p90", "p99", "p99.9", "max"};
+
+    auto const latencies = merge_latencies();
+    std::string out;
+    for(std::size_t i = 0; i < static_cast<std::size_t>(stage::count_); ++i)
+    {
+        auto const& buckets = latencies->buckets[i];
+        std::uint64_t count = 0;
+        for(auto n : buckets)
+            count += n;
+
+        char line[256];
+        auto n = std::snprintf(line, sizeof(line), "%-20s count=%llu", stages[i],
+            static_cast<unsigned long long>(count));
+        if(count > 0)
+        {
+            n += std::snprintf(line + n, sizeof(line) - n, " mean=%.1fus",
+                static_cast<double>(latencies->sum[i]) / static_cast<double>(count) / 1e3);
+
+            // Each quantile is reported as the upper limit of its bucket
+            std::uint64_t cumulative = 0;
+            std::size_t bucket = 0;
+            for(std::size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q)
+            {
+                auto const rank = static_cast<std::uint64_t>(quantiles[q] * static_cast<double>(count));
+                while(bucket < histogram::bucket_count &&
+                    (cumulative + buckets[bucket] < rank || buckets[bucket] == 0))
+                    cumulative += buckets[bucket++];
+                n += std::snprintf(line + n, sizeof(line) - n, " %s=%.1fus", names[q],
+                    static_cast<double>(histogram::bucket_limit(bucket)) / 1e3);
+            }
+        }
+        out.append(line).append("\n");
+    }
+    return out;
+}
+
+} // metrics
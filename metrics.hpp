@@ -0,0 +1,172 @@
+#ifndef IR_WEBSOCKET_SERVER_METRICS_HPP
+#define IR_WEBSOCKET_SERVER_METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Server metrics, exposed in the Prometheus text format.
+//
+// Each thread updates its own cache-line aligned block with plain
+// relaxed loads and stores, so recording never contends or takes a
+// lock. Blocks are only summed when the metrics are scraped. Blocks
+// of threads that have exited are kept so that totals never go back.
+namespace metrics {
+
+enum class counter : std::size_t
+{
+    accepts,
+    accept_errors,
+    tls_connections,
+    plain_connections,
+    responses_1xx,
+    responses_2xx,
+    responses_3xx,
+    responses_4xx,
+    responses_5xx,
+    bytes_received,
+    bytes_sent,
+    jwt_verified,
+    jwt_failed,
+    jwt_revoked,
+    access_log_dropped,
+    broadcast_dropped,
+    count_
+};
+
+enum class gauge : std::size_t
+{
+    http_sessions,
+    websocket_sessions,
+    http_response_queue,
+    event_streams,
+    count_
+};
+
+// Stages whose latency is recorded in a histogram
+enum class stage : std::size_t
+{
+    accept_to_detect,       // accept until the TLS/plain detector finished
+    tls_handshake,
+    request_read,           // first bytes of a request until it is parsed
+    handle_request,
+    time_to_first_byte,     // request parsed until its response was handed to the socket
+    websocket_upgrade,      // upgrade request, including the JWT checks, until accepted
+    websocket_message,      // message read until its echo was written
+    count_
+};
+
+// Log-bucketed histogram layout in the manner of HdrHistogram: each
+// power of two of nanoseconds is split into 8 linear sub-buckets, so
+// a recorded value is within 12.5% of the truth, up to about 18 minutes.
+namespace histogram {
+
+constexpr unsigned sub_bits = 3;
+constexpr unsigned max_exponent = 40;
+constexpr std::size_t bucket_count = (max_exponent - sub_bits + 1) << sub_bits;
+
+constexpr std::size_t
+bucket_of(std::uint64_t ns) noexcept
+{
+    if(ns >= (std::uint64_t{1} << max_exponent))
+        ns = (std::uint64_t{1} << max_exponent) - 1;
+    if(ns < (std::uint64_t{1} << sub_bits))
+        return static_cast<std::size_t>(ns);
+    unsigned exponent = 63;
+    while(! (ns >> exponent))
+        --exponent;
+    auto const shift = exponent - sub_bits;
+    auto const sub = (ns >> shift) & ((1u << sub_bits) - 1);
+    return ((shift + 1) << sub_bits) + sub;
+}
+
+// Returns the smallest value that falls in the bucket after `index`
+constexpr std::uint64_t
+bucket_limit(std::size_t index) noexcept
+{
+    if(index < (std::size_t{1} << sub_bits))
+        return index + 1;
+    auto const shift = (index >> sub_bits) - 1;
+    auto const sub = index & ((1u << sub_bits) - 1);
+    return (std::uint64_t{(1u << sub_bits) + sub} << shift) + (std::uint64_t{1} << shift);
+}
+
+} // histogram
+
+struct alignas(64) block
+{
+    std::atomic<std::uint64_t> counters[static_cast<std::size_t>(counter::count_)] = {};
+    std::atomic<std::int64_t> gauges[static_cast<std::size_t>(gauge::count_)] = {};
+    std::atomic<std::uint64_t> latency_sum[static_cast<std::size_t>(stage::count_)] = {};
+    std::atomic<std::uint64_t> latency[static_cast<std::size_t>(stage::count_)]
+                                      [histogram::bucket_count] = {};
+};
+
+// Allocate a block for the calling thread and add it to the registry
+block& register_block();
+
+inline block&
+local_block()
+{
+    thread_local block& b = register_block();
+    return b;
+}
+
+inline void
+add(counter c, std::uint64_t n = 1) noexcept
+{
+    // Only this thread writes its block, a load and store suffices
+    auto& value = local_block().counters[static_cast<std::size_t>(c)];
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Gauges may go up on one thread and down on another,
+// so a single thread's value can be negative; the sum is not
+inline void
+add(gauge g, std::int64_t n) noexcept
+{
+    auto& value = local_block().gauges[static_cast<std::size_t>(g)];
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Count a response by the class of its status code
+inline void
+add_status(unsigned status) noexcept
+{
+    if(status < 100 || status > 599)
+        return;
+    add(static_cast<counter>(
+        static_cast<std::size_t>(counter::responses_1xx) + status / 100 - 1));
+}
+
+inline void
+record(stage st, std::chrono::steady_clock::duration elapsed) noexcept
+{
+    auto const ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    auto& b = local_block();
+    auto& bucket = b.latency[static_cast<std::size_t>(st)][histogram::bucket_of(ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    auto& sum = b.latency_sum[static_cast<std::size_t>(st)];
+    sum.store(sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+}
+
+// Record the time elapsed since `start`
+inline void
+record_since(stage st, std::chrono::steady_clock::time_point start) noexcept
+{
+    record(st, std::chrono::steady_clock::now() - start);
+}
+
+// Return every metric in the Prometheus text exposition format
+std::string scrape();
+
+// Return count, mean and percentiles of every latency stage,
+// one line per stage, for printing at shutdown
+std::string latency_summary();
+
+} // metrics
+
+#endif
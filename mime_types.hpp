@@ -0,0 +1,236 @@
+#ifndef IR_WEBSOCKET_SERVER_MIME_TYPES_HPP
+#define IR_WEBSOCKET_SERVER_MIME_TYPES_HPP
+
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/string.hpp>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace detail {
+
+struct mime_entry
+{
+    std::string_view ext;
+    std::string_view type;
+};
+
+// Built-in types keyed on the lowercased extension without the dot
+inline constexpr std::array<mime_entry, 21> builtin_mime_types{{
+    {"htm",  "text/html"},
+    {"html", "text/html"},
+    {"php",  "text/html"},
+    {"css",  "text/css"},
+    {"txt",  "text/plain"},
+    {"js",   "application/javascript"},
+    {"json", "application/json"},
+    {"xml",  "application/xml"},
+    {"swf",  "application/x-shockwave-flash"},
+    {"flv",  "video/x-flv"},
+    {"png",  "image/png"},
+    {"jpe",  "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"jpg",  "image/jpeg"},
+    {"gif",  "image/gif"},
+    {"bmp",  "image/bmp"},
+    {"ico",  "image/vnd.microsoft.icon"},
+    {"tiff", "image/tiff"},
+    {"tif",  "image/tiff"},
+    {"svg",  "image/svg+xml"},
+    {"svgz", "image/svg+xml"},
+}};
+
+// Slots in the perfect hash table, a power of two
+inline constexpr std::size_t mime_slots = 64;
+
+// Hash of a lowercased extension, mixed with a seed
+// chosen at compile time to make the table collision free
+constexpr std::uint32_t
+mime_hash(std::string_view ext, std::uint32_t seed) noexcept
+{
+    std::uint32_t h = seed;
+    for(char c : ext)
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    return (h ^ (h >> 15)) & (mime_slots - 1);
+}
+
+constexpr bool
+is_perfect(std::uint32_t seed) noexcept
+{
+    bool used[mime_slots] = {};
+    for(auto const& entry : builtin_mime_types)
+    {
+        auto const slot = mime_hash(entry.ext, seed);
+        if(used[slot])
+            return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr std::uint32_t
+find_mime_seed() noexcept
+{
+    std::uint32_t seed = 2166136261u;
+    while(! is_perfect(seed))
+        ++seed;
+    return seed;
+}
+
+inline constexpr std::uint32_t mime_seed = find_mime_seed();
+
+// Maps each hash slot to its entry in builtin_mime_types, or -1
+struct mime_slot_table
+{
+    signed char index[mime_slots];
+
+    constexpr mime_slot_table()
+        : index{}
+    {
+        for(std::size_t i = 0; i < mime_slots; ++i)
+            index[i] = -1;
+        for(std::size_t i = 0; i < builtin_mime_types.size(); ++i)
+            index[mime_hash(builtin_mime_types[i].ext, mime_seed)] =
+                static_cast<signed char>(i);
+    }
+};
+
+inline constexpr mime_slot_table mime_slot{};
+
+// Longest extension worth lowercasing on the stack
+inline constexpr std::size_t max_ext_size = 16;
+
+// User supplied types, sorted by extension. Written once by
+// load_mime_types before the server starts and read-only after.
+inline std::vector<std::pair<std::string, std::string>>&
+user_mime_types()
+{
+    static std::vector<std::pair<std::string, std::string>> types;
+    return types;
+}
+
+} // detail
+
+// Load additional types in the mime.types format used by Apache and
+// nginx: a type followed by its extensions, one type per line, with
+// '#' starting a comment. Entries here take precedence over the
+// built-in table. Not thread-safe; call before the server starts.
+inline void
+load_mime_types(std::string const& path, boost::beast::error_code& ec)
+{
+    std::ifstream file(path);
+    if(! file)
+    {
+        ec = boost::beast::errc::make_error_code(
+            boost::beast::errc::no_such_file_or_directory);
+        return;
+    }
+
+    auto& types = detail::user_mime_types();
+    std::string line;
+    while(std::getline(file, line))
+    {
+        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
+        std::istringstream words(line);
+        std::string type;
+        std::string ext;
+        if(! (words >> type))
+            continue;
+        while(words >> ext)
+        {
+            if(ext.size() > detail::max_ext_size)
+                continue;
+            for(auto& c : ext)
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            types.emplace_back(std::move(ext), type);
+        }
+    }
+
+    // Later lines win, as they would in a server configuration
+    std::stable_sort(types.begin(), types.end(),
+        [](auto const& lhs, auto const& rhs)
+        {
+            return lhs.first < rhs.first;
+        });
+    types.erase(
+        types.begin(),
+        std::unique(types.rbegin(), types.rend(),
+            [](auto const& lhs, auto const& rhs)
+            {
+                return lhs.first == rhs.first;
+            }).base());
+    ec = {};
+}
+
+// Return a reasonable mime type based on the extension of a file.
+inline boost::beast::string_view
+mime_type(boost::beast::string_view path)
+{
+    auto const pos = path.rfind('.');
+    if(pos == boost::beast::string_view::npos ||
+        path.size() - pos - 1 > detail::max_ext_size)
+        return "application/text";
+
+    char buf[detail::max_ext_size];
+    auto const n = path.size() - pos - 1;
+    for(std::size_t i = 0; i < n; ++i)
+    {
+        auto const c = path[pos + 1 + i];
+        buf[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+    std::string_view const ext(buf, n);
+
+    auto const& user = detail::user_mime_types();
+    if(! user.empty())
+    {
+        auto const it = std::lower_bound(
+            user.begin(), user.end(), ext,
+            [](auto const& entry, std::string_view ext)
+            {
+                return std::string_view(entry.first) < ext;
+            });
+        if(it != user.end() && it->first == ext)
+            return {it->second.data(), it->second.size()};
+    }
+
+    auto const index = detail::mime_slot.index[
+        detail::mime_hash(ext, detail::mime_seed)];
+    if(index >= 0 && detail::builtin_mime_types[index].ext == ext)
+        return {
+            detail::builtin_mime_types[index].type.data(),
+            detail::builtin_mime_types[index].type.size()};
+    return "application/text";
+}
+
+// Returns true if responses of this type shrink when compressed.
+// Images other than SVG, audio, video and archives are already
+// compressed and only cost CPU to compress again.
+inline bool
+compressible_type(boost::beast::string_view type)
+{
+    auto const semi = type.find(';');
+    if(semi != boost::beast::string_view::npos)
+        type = type.substr(0, semi);
+    auto const ends_with = [&type](boost::beast::string_view suffix)
+    {
+        return type.size() >= suffix.size() &&
+            boost::beast::iequals(type.substr(type.size() - suffix.size()), suffix);
+    };
+    return
+        boost::beast::iequals(type.substr(0, 5), "text/") ||
+        boost::beast::iequals(type, "application/javascript") ||
+        boost::beast::iequals(type, "application/json") ||
+        boost::beast::iequals(type, "application/xml") ||
+        ends_with("+xml") ||
+        ends_with("+json");
+}
+
+#endif
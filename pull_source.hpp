@@ -0,0 +1,43 @@
+#ifndef IR_WEBSOCKET_SERVER_PULL_SOURCE_HPP
+#define IR_WEBSOCKET_SERVER_PULL_SOURCE_HPP
+
+#include "body_source.hpp"
+#include <functional>
+#include <string>
+#include <utility>
+
+// Streams a body which a handler produces on demand.
+//
+// The producer is called on the session's thread each time the
+// previous chunk has been written, and appends the next one to a
+// buffer which is reused for every chunk. A response of any size
+// therefore holds one chunk at a time, and a client which reads
+// slowly simply gets asked for less often. Pair it with a chunked
+// header when the size is not known up front.
+class pull_source : public body_source
+{
+public:
+    // Append the next chunk, returning false once it is the last.
+    // Setting ec ends the response, the connection is closed.
+    using producer = std::function<bool(std::string &chunk, beast::error_code &ec)>;
+
+    explicit pull_source(producer produce)
+        : produce_(std::move(produce))
+    {
+    }
+
+    void
+    async_next(handler_type handler) override
+    {
+        chunk_.clear();
+        beast::error_code ec;
+        auto const more = produce_(chunk_, ec);
+        handler(ec, net::buffer(chunk_), more && !ec);
+    }
+
+private:
+    producer produce_;
+    std::string chunk_;
+};
+
+#endif
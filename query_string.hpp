@@ -0,0 +1,218 @@
+#ifndef IR_WEBSOCKET_SERVER_QUERY_STRING_HPP
+#define IR_WEBSOCKET_SERVER_QUERY_STRING_HPP
+
+#include <boost/beast/core/string.hpp>
+#include <boost/optional.hpp>
+#include <cstddef>
+#include <iterator>
+
+namespace detail {
+
+// Maps a character to its hexadecimal digit value, or -1
+struct hex_digits
+{
+    signed char value[256];
+
+    constexpr hex_digits()
+        : value{}
+    {
+        for(int i = 0; i < 256; ++i)
+            value[i] = -1;
+        for(int i = 0; i < 10; ++i)
+            value['0' + i] = static_cast<signed char>(i);
+        for(int i = 0; i < 6; ++i)
+        {
+            value['a' + i] = static_cast<signed char>(10 + i);
+            value['A' + i] = static_cast<signed char>(10 + i);
+        }
+    }
+};
+
+inline constexpr hex_digits hex{};
+
+} // detail
+
+// A view of the query component of a request-target.
+//
+// Parameters are split lazily and returned as views into the
+// target, so nothing is allocated. Keys are matched as they
+// appear on the wire; values are left percent-encoded until
+// the caller decodes them into storage of its choosing.
+class query_string
+{
+    boost::beast::string_view query_;
+
+public:
+    struct param
+    {
+        boost::beast::string_view key;
+        boost::beast::string_view value;
+    };
+
+    class iterator
+    {
+        boost::beast::string_view rest_;
+        param param_;
+        bool end_ = true;
+
+        void
+        next() noexcept
+        {
+            while(! rest_.empty())
+            {
+                auto const amp = rest_.find('&');
+                auto const pair = rest_.substr(0, amp);
+                rest_ = amp == boost::beast::string_view::npos
+                    ? boost::beast::string_view{}
+                    : rest_.substr(amp + 1);
+                if(pair.empty())
+                    continue;
+                auto const eq = pair.find('=');
+                param_.key = pair.substr(0, eq);
+                param_.value = eq == boost::beast::string_view::npos
+                    ? boost::beast::string_view{}
+                    : pair.substr(eq + 1);
+                end_ = false;
+                return;
+            }
+            end_ = true;
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = param;
+        using difference_type = std::ptrdiff_t;
+        using pointer = param const*;
+        using reference = param const&;
+
+        iterator() = default;
+
+        explicit
+        iterator(boost::beast::string_view query) noexcept
+            : rest_(query)
+        {
+            next();
+        }
+
+        reference
+        operator*() const noexcept
+        {
+            return param_;
+        }
+
+        pointer
+        operator->() const noexcept
+        {
+            return &param_;
+        }
+
+        iterator&
+        operator++() noexcept
+        {
+            next();
+            return *this;
+        }
+
+        iterator
+        operator++(int) noexcept
+        {
+            auto temp = *this;
+            next();
+            return temp;
+        }
+
+        friend bool
+        operator==(iterator const& lhs, iterator const& rhs) noexcept
+        {
+            if(lhs.end_ || rhs.end_)
+                return lhs.end_ == rhs.end_;
+            return lhs.param_.key.data() == rhs.param_.key.data();
+        }
+
+        friend bool
+        operator!=(iterator const& lhs, iterator const& rhs) noexcept
+        {
+            return ! (lhs == rhs);
+        }
+    };
+
+    // Construct from a request-target such as "/path?a=1&b=2#frag"
+    explicit
+    query_string(boost::beast::string_view target) noexcept
+    {
+        auto const question = target.find('?');
+        if(question == boost::beast::string_view::npos)
+            return;
+        query_ = target.substr(question + 1);
+        query_ = query_.substr(0, query_.find('#'));
+    }
+
+    boost::beast::string_view
+    str() const noexcept
+    {
+        return query_;
+    }
+
+    iterator
+    begin() const noexcept
+    {
+        return iterator(query_);
+    }
+
+    iterator
+    end() const noexcept
+    {
+        return iterator();
+    }
+
+    // Return the encoded value of the first parameter named `key`
+    boost::optional<boost::beast::string_view>
+    find(boost::beast::string_view key) const noexcept
+    {
+        for(auto const& p : *this)
+            if(p.key == key)
+                return p.value;
+        return boost::none;
+    }
+
+    // Returns true if `in` contains escapes that decode() would rewrite
+    static bool
+    needs_decode(boost::beast::string_view in) noexcept
+    {
+        for(char c : in)
+            if(c == '%' || c == '+')
+                return true;
+        return false;
+    }
+
+    // Decode percent-escapes and '+' from `in` into `out`, which must
+    // have room for in.size() characters. `out` may be in.data() to
+    // decode in place. Malformed escapes are copied through unchanged.
+    // Returns the number of characters written.
+    static std::size_t
+    decode(boost::beast::string_view in, char* out) noexcept
+    {
+        auto const* p = in.data();
+        auto const* const last = p + in.size();
+        auto* const first = out;
+        while(p != last)
+        {
+            if(*p == '%' && last - p > 2)
+            {
+                auto const hi = detail::hex.value[static_cast<unsigned char>(p[1])];
+                auto const lo = detail::hex.value[static_cast<unsigned char>(p[2])];
+                if((hi | lo) >= 0)
+                {
+                    *out++ = static_cast<char>((hi << 4) | lo);
+                    p += 3;
+                    continue;
+                }
+            }
+            *out++ = *p == '+' ? ' ' : *p;
+            ++p;
+        }
+        return static_cast<std::size_t>(out - first);
+    }
+};
+
+#endif
@@ -1,41 +1,39 @@
 #include "base.hpp"
-#include <boost/beast/version.hpp>
+#include "access_token.hpp"
+#include "body_source.hpp"
+#include "compression.hpp"
+#include "content_coding.hpp"
+#include "directory_listing.hpp"
+#include "event_stream.hpp"
+#include "file_range_body.hpp"
+#include "file_source.hpp"
+#include "logging.hpp"
+#include "mapped_file.hpp"
+#include <random>
 #include "include/jwt-cpp/traits/boost-json/defaults.h"
+#include "metrics.hpp"
+#include "mime_types.hpp"
+#include "pull_source.hpp"
+#include "response_headers.hpp"
+#include "router.hpp"
+#include "shared_state.hpp"
+#include "shared_string_body.hpp"
 
-// Return a reasonable mime type based on the extension of a file.
-beast::string_view
-mime_type(beast::string_view path)
-{
-    using beast::iequals;
-    auto const ext = [&path]
-    {
-        auto const pos = path.rfind(".");
-        if(pos == beast::string_view::npos)
-            return beast::string_view{};
-        return path.substr(pos);
-    }();
-    if(iequals(ext, ".htm"))  return "text/html";
-    if(iequals(ext, ".html")) return "text/html";
-    if(iequals(ext, ".php"))  return "text/html";
-    if(iequals(ext, ".css"))  return "text/css";
-    if(iequals(ext, ".txt"))  return "text/plain";
-    if(iequals(ext, ".js"))   return "application/javascript";
-    if(iequals(ext, ".json")) return "application/json";
-    if(iequals(ext, ".xml"))  return "application/xml";
-    if(iequals(ext, ".swf"))  return "application/x-shockwave-flash";
-    if(iequals(ext, ".flv"))  return "video/x-flv";
-    if(iequals(ext, ".png"))  return "image/png";
-    if(iequals(ext, ".jpe"))  return "image/jpeg";
-    if(iequals(ext, ".jpeg")) return "image/jpeg";
-    if(iequals(ext, ".jpg"))  return "image/jpeg";
-    if(iequals(ext, ".gif"))  return "image/gif";
-    if(iequals(ext, ".bmp"))  return "image/bmp";
-    if(iequals(ext, ".ico"))  return "image/vnd.microsoft.icon";
-    if(iequals(ext, ".tiff")) return "image/tiff";
-    if(iequals(ext, ".tif"))  return "image/tiff";
-    if(iequals(ext, ".svg"))  return "image/svg+xml";
-    if(iequals(ext, ".svgz")) return "image/svg+xml";
-    return "application/text";
+// Return a random token id for the "jti" claim, so that
+// an issued token can later be revoked on its own.
+std::string
+make_token_id()
+{
+    thread_local std::mt19937_64 rng{std::random_device{}()};
+    char constexpr digits[] = "0123456789abcdef";
+    std::string id(32, '0');
+    for(std::size_t i = 0; i < id.size(); i += 16)
+    {
+        auto v = rng();
+        for(std::size_t j = 0; j < 16; ++j, v >>= 4)
+            id[i + j] = digits[v & 15];
+    }
+    return id;
 }
 
 // Append an HTTP rel-path to a local filesystem path.
@@ -61,98 +59,328 @@ path_cat(
     if(result.back() == path_separator)
         result.resize(result.size() - 1);
     result.append(path.data(), path.size());
+    normalize_path(result);
 #endif
     return result;
 }
 
-// Return a response for the given request.
-//
-// The concrete type of the response message (which depends on the
-// request), is type-erased in message_generator.
-template<class Body, class Allocator>
-http::message_generator
-handle_request(
-    beast::string_view doc_root,
-    http::request<Body, http::basic_fields<Allocator>>&& req)
-{
-    if (req.target() == "/api/ws" &&
-        req.method() == http::verb::get)
-    {
-        const auto token = jwt::create<jwt::traits::boost_json>()
-            .set_issuer("auth0")
-            .set_audience("aud0")
-            .set_issued_at(std::chrono::system_clock::now())
-            .set_expires_at(std::chrono::system_clock::now() + std::chrono::seconds{3600})
-            .sign(jwt::algorithm::hs256{"secret"});
-
-        http::response<http::string_body> res{http::status::ok, req.version()};
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-        res.set(http::field::content_type, "application/json");
-        res.keep_alive(req.keep_alive());
-        res.body() = boost::json::serialize(token); // Convert the JSON object to a string
-        res.prepare_payload();
-        return res;
+// The representation of a static file chosen for a request: the file
+// itself, one of its precompressed siblings, or a copy the server
+// compresses itself
+struct static_representation
+{
+    std::string path;                   // the file to open
+    std::uint64_t size;                 // 0 until a dynamic copy is made
+    std::string etag;
+    beast::string_view content_type;    // of the file itself
+    beast::string_view encoding;        // empty for the file itself
+    boost::optional<compression> dynamic;
+    file_info const* info;
+    bool vary;                          // other encodings exist
+
+    // The path of the file itself, which keys the metadata cache
+    std::string
+    source_path() const
+    {
+        return encoding.empty() || dynamic ? path : path.substr(0, path.size() - 3);
     }
+};
+
+// Pick the better of two codings the client accepts, or none.
+// The first wins a tie.
+inline int
+prefer_encoding(beast::string_view accept_encoding,
+    bool first_available, beast::string_view first,
+    bool second_available, beast::string_view second)
+{
+    auto const a = first_available ? accept_weight(accept_encoding, first) : 0;
+    auto const b = second_available ? accept_weight(accept_encoding, second) : 0;
+    if(a > 0 && a >= b)
+        return 1;
+    return b > 0 ? 2 : 0;
+}
 
-    // Returns a bad request response
-    auto const bad_request =
-    [&req](beast::string_view why)
+// Choose between the file and its compressed forms. Precompressed
+// siblings come first, brotli winning a tie since it is the smaller.
+// Otherwise a compressible file may be compressed on the fly, unless
+// `allow_dynamic` is false because the request asks for byte ranges.
+inline static_representation
+choose_representation(
+    std::string path,
+    file_info const& info,
+    beast::string_view accept_encoding,
+    bool allow_dynamic)
+{
+    static_representation rep{
+        std::move(path), info.size, info.etag, {}, {}, {}, &info,
+        info.brotli || info.gzip};
+    rep.content_type = mime_type(rep.path);
+
+    switch(prefer_encoding(accept_encoding,
+        info.brotli.has_value(), "br", info.gzip.has_value(), "gzip"))
     {
-        http::response<http::string_body> res{http::status::bad_request, req.version()};
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-        res.set(http::field::content_type, "text/html");
-        res.keep_alive(req.keep_alive());
-        res.body() = std::string(why);
-        res.prepare_payload();
-        return res;
-    };
+    case 1:
+        rep.path.append(".br");
+        rep.size = info.brotli->size;
+        rep.etag = info.brotli->etag;
+        rep.encoding = "br";
+        return rep;
+    case 2:
+        rep.path.append(".gz");
+        rep.size = info.gzip->size;
+        rep.etag = info.gzip->etag;
+        rep.encoding = "gzip";
+        return rep;
+    }
 
-    // Returns a not found response
-    auto const not_found =
-    [&req](beast::string_view target)
+    if(rep.vary ||
+        info.size < min_compress_size ||
+        info.size > compression_cache::max_file_size ||
+        ! compressible_type(rep.content_type))
+        return rep;
+
+    // The response now depends on Accept-Encoding even when
+    // the client gets the file as it is
+    rep.vary = true;
+    if(! allow_dynamic)
+        return rep;
+    switch(prefer_encoding(accept_encoding, true, "gzip", true, "deflate"))
     {
-        http::response<http::string_body> res{http::status::not_found, req.version()};
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-        res.set(http::field::content_type, "text/html");
-        res.keep_alive(req.keep_alive());
-        res.body() = "The resource '" + std::string(target) + "' was not found.";
-        res.prepare_payload();
-        return res;
+    case 1:
+        rep.dynamic = compression::gzip;
+        break;
+    case 2:
+        rep.dynamic = compression::deflate;
+        break;
+    default:
+        return rep;
+    }
+    rep.encoding = to_string(*rep.dynamic);
+    rep.size = 0;
+    rep.etag.insert(rep.etag.size() - 1, "-" + std::string(rep.encoding));
+    return rep;
+}
+
+// Compress a body built for this request when the client accepts it.
+// Such bodies are not cached, so only responses worth it qualify.
+inline void
+compress_body(
+    beast::string_view accept_encoding,
+    response<http::string_body>& res)
+{
+    if(res.body().size() < min_compress_size ||
+        ! compressible_type(res[http::field::content_type]))
+        return;
+
+    res.insert(http::field::vary, "Accept-Encoding");
+    compression c;
+    switch(prefer_encoding(accept_encoding, true, "gzip", true, "deflate"))
+    {
+    case 1:
+        c = compression::gzip;
+        break;
+    case 2:
+        c = compression::deflate;
+        break;
+    default:
+        return;
+    }
+
+    std::string out;
+    if(! compress(res.body(), c, out))
+        return;
+    res.body() = std::move(out);
+    res.insert(http::field::content_encoding, to_string(c));
+}
+
+// Add the validators and negotiation fields of a representation
+template<class Body, class Fields>
+void
+add_representation_headers(
+    http::response<Body, Fields>& res,
+    static_representation const& rep)
+{
+    res.insert(http::field::etag, rep.etag);
+    res.insert(http::field::last_modified, rep.info->last_modified);
+    if(! rep.encoding.empty())
+        res.insert(http::field::content_encoding, rep.encoding);
+    if(rep.vary)
+        res.insert(http::field::vary, "Accept-Encoding");
+}
+
+// Returns true if a conditional GET or HEAD can be answered with
+// 304 Not Modified. If-None-Match takes precedence when both are sent.
+template<class Fields>
+bool
+not_modified(Fields const& fields, static_representation const& rep)
+{
+    auto const if_none_match = fields[http::field::if_none_match];
+    if(! if_none_match.empty())
+        return etag_matches(if_none_match, rep.etag);
+
+    std::time_t since;
+    auto const if_modified_since = fields[http::field::if_modified_since];
+    return ! if_modified_since.empty() &&
+        parse_http_date(if_modified_since, since) &&
+        rep.info->mtime <= since;
+}
+
+// Returns true unless an If-Range field names another version of the
+// file, in which case the ranges are ignored and the whole file sent
+template<class Fields>
+bool
+if_range_matches(Fields const& fields, static_representation const& rep)
+{
+    auto const if_range = fields[http::field::if_range];
+    if(if_range.empty())
+        return true;
+
+    // Only a strong validator may match
+    if(if_range.front() == '"')
+        return if_range == rep.etag;
+    std::time_t date;
+    return parse_http_date(if_range, date) && date == rep.info->mtime;
+}
+
+// Return a 206 response with the requested ranges of a file, as a
+// multipart/byteranges body when there is more than one
+template<class Body, class Allocator>
+http::message_generator
+range_response(
+    http::request<Body, http::basic_fields<Allocator>> const& req,
+    static_representation const& rep,
+    std::vector<byte_range> const& ranges,
+    file_range_body::value_type body)
+{
+    auto const content_range = [&rep](byte_range r)
+    {
+        return "bytes " + std::to_string(r.first) + "-" + std::to_string(r.last) +
+            "/" + std::to_string(rep.size);
     };
 
-    // Returns a server error response
-    auto const server_error =
-    [&req](beast::string_view what)
+    std::string multipart_type;
+    if(ranges.size() == 1)
     {
-        http::response<http::string_body> res{http::status::internal_server_error, req.version()};
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-        res.set(http::field::content_type, "text/html");
-        res.keep_alive(req.keep_alive());
-        res.body() = "An error occurred: '" + std::string(what) + "'";
-        res.prepare_payload();
-        return res;
+        body.parts.push_back({{}, ranges[0].first, ranges[0].last - ranges[0].first + 1});
+    }
+    else
+    {
+        auto const boundary = make_token_id();
+        for(auto const& r : ranges)
+        {
+            body.parts.push_back({
+                (body.parts.empty() ? "--" : "\r\n--") + boundary +
+                    "\r\nContent-Type: " + std::string(rep.content_type) +
+                    "\r\nContent-Range: " + content_range(r) + "\r\n\r\n",
+                r.first,
+                r.last - r.first + 1});
+        }
+        body.tail = "\r\n--" + boundary + "--\r\n";
+        multipart_type = "multipart/byteranges; boundary=" + boundary;
+    }
+
+    response<file_range_body> res{
+        std::piecewise_construct,
+        std::make_tuple(std::move(body)),
+        std::make_tuple(http::status::partial_content, req.version())};
+    add_common_headers(res, ranges.size() == 1
+        ? rep.content_type
+        : beast::string_view(multipart_type));
+    if(ranges.size() == 1)
+        res.insert(http::field::content_range, content_range(ranges[0]));
+    add_representation_headers(res, rep);
+    res.content_length(res.body().size());
+    res.keep_alive(req.keep_alive());
+    return res;
+}
+
+// Return a text/html response for an error
+template<class Request>
+response<http::string_body>
+error_response(Request const& req, http::status status, std::string body)
+{
+    response<http::string_body> res{status, req.version()};
+    add_common_headers(res, "text/html");
+    res.keep_alive(req.keep_alive());
+    res.body() = std::move(body);
+    res.prepare_payload();
+    return res;
+}
+
+// Issue a signed token for the WebSocket endpoint
+template<class Request>
+response_message
+issue_token(route_context<Request>& ctx)
+{
+    auto const& req = ctx.request();
+    const auto token = jwt::create<jwt::traits::boost_json>()
+        .set_issuer("auth0")
+        .set_audience("aud0")
+        .set_id(make_token_id())
+        .set_issued_at(std::chrono::system_clock::now())
+        .set_expires_at(std::chrono::system_clock::now() + std::chrono::seconds{3600})
+        .sign(jwt::algorithm::hs256{"secret"});
+
+    response<http::string_body> res{http::status::ok, req.version()};
+    add_common_headers(res, "application/json");
+    res.keep_alive(req.keep_alive());
+    res.body() = boost::json::serialize(token); // Convert the JSON object to a string
+    compress_body(req[http::field::accept_encoding], res);
+    res.prepare_payload();
+    return res;
+}
+
+// Reserved for the metrics scraper
+template<class Request>
+response_message
+scrape_metrics(route_context<Request>& ctx)
+{
+    auto const& req = ctx.request();
+    response<http::string_body> res{http::status::ok, req.version()};
+    add_common_headers(res, "text/plain; version=0.0.4");
+    res.keep_alive(req.keep_alive());
+    res.body() = metrics::scrape();
+    compress_body(req[http::field::accept_encoding], res);
+    res.prepare_payload();
+    return res;
+}
+
+// Serve a file under doc_root, for any GET or HEAD no other route takes.
+//
+// The concrete type of the response message (which depends on the
+// request), is type-erased in message_generator. Large files are
+// streamed from a file_source instead.
+template<class Request>
+response_message
+serve_file(route_context<Request>& ctx)
+{
+    auto& state = ctx.state();
+    auto const& req = ctx.request();
+
+    auto const not_found = [&req](beast::string_view target)
+    {
+        return error_response(req, http::status::not_found,
+            "The resource '" + std::string(target) + "' was not found.");
     };
 
-    // Make sure we can handle the method
-    if( req.method() != http::verb::get &&
-        req.method() != http::verb::head)
-        return bad_request("Unknown HTTP-method");
+    auto const server_error = [&req](beast::string_view what)
+    {
+        return error_response(req, http::status::internal_server_error,
+            "An error occurred: '" + std::string(what) + "'");
+    };
 
-    // Request path must be absolute and not contain "..".
-    if( req.target().empty() ||
-        req.target()[0] != '/' ||
-        req.target().find("..") != beast::string_view::npos)
-        return bad_request("Illegal request-target");
+    // Request path must not contain "..".
+    if(ctx.path().find("..") != beast::string_view::npos)
+        return error_response(req, http::status::bad_request, "Illegal request-target");
 
     // Build the path to the requested file
-    std::string path = path_cat(doc_root, req.target());
-    if(req.target().back() == '/')
+    std::string path = path_cat(state.doc_root(), ctx.path());
+    if(ctx.path().back() == '/')
         path.append("index.html");
 
-    // Attempt to open the file
+    // Look the file up in the metadata cache
     beast::error_code ec;
-    http::file_body::value_type body;
-    body.open(path.c_str(), beast::file_mode::scan, ec);
+    auto const info = state.files().lookup(path, ec);
 
     // Handle the case where the file doesn't exist
     if(ec == beast::errc::no_such_file_or_directory)
@@ -162,28 +390,422 @@ handle_request(
     if(ec)
         return server_error(ec.message());
 
-    // Cache the size since we need it after the move
-    auto const size = body.size();
+    // Pick the file or a compressed form of it
+    auto const range = req[http::field::range];
+    auto rep = choose_representation(
+        std::move(path), *info, req[http::field::accept_encoding], range.empty());
+
+    // Compress on the fly, once per version of the file. That happens
+    // on the file pool, and the file is sent as it is until then.
+    std::shared_ptr<std::string const> compressed;
+    if(rep.dynamic)
+    {
+        compressed = state.compressed().find(*info, *rep.dynamic);
+        if(! compressed && req.method() == http::verb::get)
+            state.compressed().prepare(
+                state.file_pool(), rep.path, *info, *rep.dynamic);
+        if(compressed)
+            rep.size = compressed->size();
+        else
+            rep = choose_representation(
+                std::move(rep.path), *info, req[http::field::accept_encoding], false);
+    }
+
+    // Answer a revalidation without opening the file
+    if(not_modified(req, rep))
+    {
+        response<http::empty_body> res{http::status::not_modified, req.version()};
+        add_common_headers(res, {});
+        add_representation_headers(res, rep);
+        res.keep_alive(req.keep_alive());
+        return res;
+    }
 
     // Respond to HEAD request
     if(req.method() == http::verb::head)
     {
-        http::response<http::empty_body> res{http::status::ok, req.version()};
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-        res.set(http::field::content_type, mime_type(path));
-        res.content_length(size);
+        response<http::empty_body> res{http::status::ok, req.version()};
+        add_common_headers(res, rep.content_type);
+        add_representation_headers(res, rep);
+        res.insert(http::field::accept_ranges, "bytes");
+        res.content_length(rep.size);
+        res.keep_alive(req.keep_alive());
+        return res;
+    }
+
+    // Byte ranges of the representation, unless If-Range says it has changed
+    std::vector<byte_range> ranges;
+    auto const ranged = ! range.empty() && if_range_matches(req, rep)
+        ? parse_range(range, rep.size, ranges)
+        : range_result::ignore;
+
+    if(ranged == range_result::unsatisfiable)
+    {
+        response<http::empty_body> res{http::status::range_not_satisfiable, req.version()};
+        add_common_headers(res, {});
+        res.insert(http::field::content_range, "bytes */" + std::to_string(rep.size));
+        res.content_length(0);
         res.keep_alive(req.keep_alive());
         return res;
     }
 
+    if(ranged == range_result::satisfiable)
+    {
+        file_range_body::value_type body;
+        body.file.open(rep.path.c_str(), beast::file_mode::read, ec);
+        if(ec == beast::errc::no_such_file_or_directory)
+        {
+            state.files().invalidate(rep.source_path());
+            return not_found(req.target());
+        }
+        if(ec)
+            return server_error(ec.message());
+        return range_response(req, rep, ranges, std::move(body));
+    }
+
+    if(compressed)
+    {
+        response<shared_string_body> res{
+            std::piecewise_construct,
+            std::make_tuple(std::move(compressed)),
+            std::make_tuple(http::status::ok, req.version())};
+        add_common_headers(res, rep.content_type);
+        add_representation_headers(res, rep);
+        res.content_length(rep.size);
+        res.keep_alive(req.keep_alive());
+        return res;
+    }
+
+    // Send mid-sized files from a mapping shared by every request for them
+    if(rep.size >= mapping_cache::min_size && rep.size <= state.mappings().max_size())
+    {
+        auto file = state.mappings().get(rep.path, rep.etag, rep.size, ec);
+        if(! ec)
+        {
+            response<mapped_body> res{
+                std::piecewise_construct,
+                std::make_tuple(std::move(file)),
+                std::make_tuple(http::status::ok, req.version())};
+            add_common_headers(res, rep.content_type);
+            add_representation_headers(res, rep);
+            res.insert(http::field::accept_ranges, "bytes");
+            res.content_length(rep.size);
+            res.keep_alive(req.keep_alive());
+            return res;
+        }
+
+        // The file changed since it was cached, so rep.size cannot be
+        // trusted by the other ways of sending it either
+        state.files().invalidate(rep.source_path());
+        if(ec == beast::errc::no_such_file_or_directory)
+            return not_found(req.target());
+        return server_error(ec.message());
+    }
+
+    // Stream large files, reading them off the io threads when they
+    // are not in the page cache
+    if(rep.size >= file_source::min_size)
+    {
+        auto source = std::make_shared<file_source>(state.file_pool(), rep.size);
+        source->open(rep.path.c_str(), ec);
+        if(ec == beast::errc::no_such_file_or_directory)
+        {
+            state.files().invalidate(rep.source_path());
+            return not_found(req.target());
+        }
+        if(ec)
+            return server_error(ec.message());
+
+        response<http::buffer_body> res{http::status::ok, req.version()};
+        add_common_headers(res, rep.content_type);
+        add_representation_headers(res, rep);
+        res.insert(http::field::accept_ranges, "bytes");
+        res.content_length(rep.size);
+        res.keep_alive(req.keep_alive());
+        return response_message(std::move(res), std::move(source));
+    }
+
+    // Attempt to open the file
+    http::file_body::value_type body;
+    body.open(rep.path.c_str(), beast::file_mode::scan, ec);
+
+    // The file went away since it was cached
+    if(ec == beast::errc::no_such_file_or_directory)
+    {
+        state.files().invalidate(rep.source_path());
+        return not_found(req.target());
+    }
+
+    if(ec)
+        return server_error(ec.message());
+
+    // Cache the size since we need it after the move
+    auto const size = body.size();
+
     // Respond to GET request
-    http::response<http::file_body> res{
+    response<http::file_body> res{
         std::piecewise_construct,
         std::make_tuple(std::move(body)),
         std::make_tuple(http::status::ok, req.version())};
-    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-    res.set(http::field::content_type, mime_type(path));
+    add_common_headers(res, rep.content_type);
+    add_representation_headers(res, rep);
+    res.insert(http::field::accept_ranges, "bytes");
     res.content_length(size);
     res.keep_alive(req.keep_alive());
     return res;
 }
+
+// The response to a request whose access token was not accepted
+template<class Request>
+response<http::string_body>
+unauthorized(Request const& req, std::string const& error)
+{
+    FLEX_LOG_LIMITED(info, "access token rejected: %s", error.c_str());
+    auto res = error_response(req, http::status::unauthorized, "Unauthorized: " + error);
+    res.set(http::field::www_authenticate, "Bearer");
+    return res;
+}
+
+// Refuse a request without a valid access token
+template<class Request>
+boost::optional<response<http::string_body>>
+check_access(shared_state& state, Request const& req)
+{
+    std::string error;
+    if(verify_access_token(state, request_token(req.target(), req[http::field::authorization]), error))
+        return boost::none;
+    return unauthorized(req, error);
+}
+
+// Open the file an upload is written to. The name is a single path
+// segment, so it cannot leave upload_dir, and one starting with '.'
+// is refused so that an upload never lands on a hidden or partial file.
+inline std::shared_ptr<body_sink>
+open_upload(shared_state& state, route_params const& params, beast::error_code& ec)
+{
+    if(state.upload_dir().empty())
+    {
+        ec = beast::errc::make_error_code(beast::errc::operation_not_supported);
+        return nullptr;
+    }
+    auto const name = params.get("name");
+    if(name.empty() || name.front() == '.')
+    {
+        ec = beast::errc::make_error_code(beast::errc::invalid_argument);
+        return nullptr;
+    }
+    auto sink = std::make_shared<file_sink>(path_cat(state.upload_dir(), "/" + std::string(name)), ec);
+    if(ec)
+        return nullptr;
+    return sink;
+}
+
+// Respond to an upload, which the session has written to the sink
+// open_upload returned by the time this is called
+template<class Request>
+response_message
+receive_upload(route_context<Request>& ctx)
+{
+    auto const& req = ctx.request();
+    auto const ec = ctx.body_error();
+    // plan_body checked the token before the body was read
+    if(ec == beast::errc::permission_denied)
+        return unauthorized(req, ctx.access_refused());
+    if(ec == beast::errc::operation_not_supported)
+        return error_response(req, http::status::not_found,
+            "The resource '" + std::string(req.target()) + "' was not found.");
+    if(ec == beast::errc::invalid_argument)
+        return error_response(req, http::status::bad_request, "Illegal upload name");
+    if(ec || ! ctx.sink())
+        return error_response(req, http::status::internal_server_error,
+            "An error occurred: '" + (ec ? ec.message() : std::string("no body")) + "'");
+
+    response<http::string_body> res{http::status::created, req.version()};
+    add_common_headers(res, "text/plain");
+    res.set(http::field::location, ctx.path());
+    res.keep_alive(req.keep_alive());
+    res.prepare_payload();
+    return res;
+}
+
+// List the uploaded files as JSON. The listing is produced as the
+// client reads it and sent with chunked encoding, so its size does not
+// matter.
+template<class Request>
+response_message
+list_uploads(route_context<Request>& ctx)
+{
+    auto& state = ctx.state();
+    auto const& req = ctx.request();
+    if(state.upload_dir().empty())
+        return error_response(req, http::status::not_found,
+            "The resource '" + std::string(req.target()) + "' was not found.");
+    if(auto refused = check_access(state, req))
+        return std::move(*refused);
+
+    auto listing = std::make_shared<directory_listing>();
+    beast::error_code ec;
+    listing->open(state.upload_dir().c_str(), ec);
+    if(ec)
+        return error_response(req, http::status::internal_server_error,
+            "An error occurred: '" + ec.message() + "'");
+
+    response<http::buffer_body> res{http::status::ok, req.version()};
+    add_common_headers(res, "application/json");
+    res.keep_alive(req.keep_alive());
+    res.chunked(true);
+    return response_message(std::move(res), std::make_shared<pull_source>(
+        [listing](std::string& chunk, beast::error_code& ec)
+        {
+            return listing->next(chunk, ec);
+        }));
+}
+
+// Send broadcasts as server-sent events, for clients which cannot use
+// a WebSocket. The response never ends, so nothing more is read from
+// the connection and it closes when the client goes away.
+template<class Request>
+response_message
+stream_events(route_context<Request>& ctx)
+{
+    auto const& req = ctx.request();
+    if(auto refused = check_access(ctx.state(), req))
+        return std::move(*refused);
+
+    response<http::buffer_body> res{http::status::ok, req.version()};
+    add_common_headers(res, "text/event-stream");
+    res.set(http::field::cache_control, "no-cache");
+    res.keep_alive(false);
+    if(req.version() >= 11)
+        res.chunked(true);
+
+    auto events = std::make_shared<event_stream>();
+    ctx.state().broadcasts().subscribe(events);
+    return response_message(std::move(res), std::move(events));
+}
+
+// Send the request body to every WebSocket session and event stream
+template<class Request>
+response_message
+publish_broadcast(route_context<Request>& ctx)
+{
+    auto const& req = ctx.request();
+    if(auto refused = check_access(ctx.state(), req))
+        return std::move(*refused);
+
+    auto const subscribers = ctx.state().broadcasts().publish(
+        beast::string_view(req.body().data(), req.body().size()));
+
+    response<http::string_body> res{http::status::ok, req.version()};
+    add_common_headers(res, "application/json");
+    res.keep_alive(req.keep_alive());
+    res.body() = "{\"subscribers\":" + std::to_string(subscribers) + "}";
+    res.prepare_payload();
+    return res;
+}
+
+// The routes of the server, built once per request type
+template<class Request>
+router<Request>
+make_router()
+{
+    router<Request> routes;
+    routes.add(http::verb::get, "/api/ws", &issue_token<Request>);
+    routes.add(http::verb::get, "/metrics", &scrape_metrics<Request>);
+    routes.add(http::verb::get, "/api/events", &stream_events<Request>);
+    routes.add(http::verb::post, "/api/broadcast", &publish_broadcast<Request>,
+        body_policy{64 * 1024, {}});
+    routes.add(http::verb::get, "/api/uploads", &list_uploads<Request>);
+    routes.add(http::verb::put, "/uploads/:name", &receive_upload<Request>,
+        body_policy{64 * 1024 * 1024, &open_upload, true});
+    routes.add(http::verb::get, "/*path", &serve_file<Request>);
+    routes.add(http::verb::head, "/*path", &serve_file<Request>);
+    return routes;
+}
+
+template<class Request>
+router<Request> const&
+server_routes()
+{
+    static router<Request> const routes = make_router<Request>();
+    return routes;
+}
+
+// Decide how to read the body of a request from its header. Requests
+// no route takes are read with the default limit and then refused.
+template<class Request, class Fields>
+body_plan
+plan_body(shared_state& state, http::request_header<Fields> const& header)
+{
+    body_plan plan;
+    auto const target = header.target();
+    if(target.empty() || target[0] != '/')
+        return plan;
+
+    route_params params;
+    std::string allow;
+    auto const route = server_routes<Request>().find(
+        header.method(), target.substr(0, target.find('?')), params, allow);
+    if(! route)
+        return plan;
+
+    plan.limit = route->body.limit;
+    if(route->body.authorize)
+    {
+        if(! verify_access_token(state,
+            request_token(target, header[http::field::authorization]), plan.refused))
+        {
+            plan.ec = beast::errc::make_error_code(beast::errc::permission_denied);
+            return plan;
+        }
+    }
+    if(route->body.open)
+    {
+        plan.sink = route->body.open(state, params, plan.ec);
+        if(plan.ec)
+            plan.sink.reset();
+    }
+    return plan;
+}
+
+// Return a response for the given request, whose body was read as
+// plan_body decided
+template<class Body, class Allocator>
+response_message
+handle_request(
+    shared_state& state,
+    http::request<Body, http::basic_fields<Allocator>>&& req,
+    body_plan body = {})
+{
+    using request_type = http::request<Body, http::basic_fields<Allocator>>;
+    auto const& routes = server_routes<request_type>();
+
+    // Request path must be absolute
+    auto const target = req.target();
+    if(target.empty() || target[0] != '/')
+        return error_response(req, http::status::bad_request, "Illegal request-target");
+
+    // The session refused the body as larger than its route allows
+    if(body.ec == http::error::body_limit)
+        return error_response(req, http::status::payload_too_large, "The request body is too large");
+
+    // The parser refused the body, such as for a malformed chunk
+    if(body.ec && body.ec.category() == http::make_error_code(http::error::body_limit).category())
+        return error_response(req, http::status::bad_request, "Malformed request body");
+
+    // Routes match the path, without the query
+    route_context<request_type> ctx(state, req, target.substr(0, target.find('?')), std::move(body));
+    std::string allow;
+    if(auto const route = routes.find(req.method(), ctx.path(), ctx.params(), allow))
+        return route->handle(ctx);
+
+    if(! allow.empty())
+    {
+        auto res = error_response(req, http::status::method_not_allowed, "Unknown HTTP-method");
+        res.set(http::field::allow, allow);
+        return res;
+    }
+
+    return error_response(req, http::status::not_found,
+        "The resource '" + std::string(target) + "' was not found.");
+}
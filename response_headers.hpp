@@ -0,0 +1,134 @@
+#ifndef IR_WEBSOCKET_SERVER_RESPONSE_HEADERS_HPP
+#define IR_WEBSOCKET_SERVER_RESPONSE_HEADERS_HPP
+
+#include "base.hpp"
+#include "session_pool.hpp"
+#include <boost/beast/version.hpp>
+#include <algorithm>
+#include <ctime>
+
+// Response header fields are allocated from the per-thread block cache,
+// so building a response copies the values into recycled blocks
+// instead of going to malloc once per field
+using response_fields = http::basic_fields<pool_allocator<char>>;
+
+template <class Body>
+using response = http::response<Body, response_fields>;
+
+namespace detail {
+
+struct date_cache
+{
+    std::time_t second = -1;
+    char text[29];
+};
+
+inline constexpr char http_days[] = "SunMonTueWedThuFriSat";
+inline constexpr char http_months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+inline void
+format_http_date(std::time_t t, char *out) noexcept
+{
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    auto const two = [&out](int v)
+    {
+        *out++ = static_cast<char>('0' + v / 10);
+        *out++ = static_cast<char>('0' + v % 10);
+    };
+
+    // Sun, 06 Nov 1994 08:49:37 GMT
+    out = std::copy_n(http_days + 3 * tm.tm_wday, 3, out);
+    *out++ = ',';
+    *out++ = ' ';
+    two(tm.tm_mday);
+    *out++ = ' ';
+    out = std::copy_n(http_months + 3 * tm.tm_mon, 3, out);
+    *out++ = ' ';
+    two((tm.tm_year + 1900) / 100);
+    two((tm.tm_year + 1900) % 100);
+    *out++ = ' ';
+    two(tm.tm_hour);
+    *out++ = ':';
+    two(tm.tm_min);
+    *out++ = ':';
+    two(tm.tm_sec);
+    std::copy_n(" GMT", 4, out);
+}
+
+} // detail
+
+// The current time as an IMF-fixdate for the Date header. Each thread
+// formats it at most once per second and returns the same bytes
+// until the second changes.
+inline beast::string_view
+http_date() noexcept
+{
+    thread_local detail::date_cache cache;
+    auto const now = std::time(nullptr);
+    if (now != cache.second)
+    {
+        detail::format_http_date(now, cache.text);
+        cache.second = now;
+    }
+    return {cache.text, sizeof(cache.text)};
+}
+
+// Parse an IMF-fixdate, the format every current client sends. Returns
+// false for anything else, and callers then ignore the field.
+inline bool
+parse_http_date(beast::string_view s, std::time_t &t) noexcept
+{
+    // Sun, 06 Nov 1994 08:49:37 GMT
+    if (s.size() != 29 || s[3] != ',' || s.substr(25) != " GMT")
+        return false;
+
+    bool valid = true;
+    auto const number = [&](std::size_t pos, std::size_t digits)
+    {
+        int v = 0;
+        for (auto c : s.substr(pos, digits))
+        {
+            if (c < '0' || c > '9')
+                valid = false;
+            v = v * 10 + (c - '0');
+        }
+        return v;
+    };
+
+    beast::string_view const months = detail::http_months;
+    auto const month = months.find(s.substr(8, 3));
+    if (month == beast::string_view::npos || month % 3 != 0)
+        return false;
+
+    std::tm tm{};
+    tm.tm_mday = number(5, 2);
+    tm.tm_mon = static_cast<int>(month / 3);
+    tm.tm_year = number(12, 4) - 1900;
+    tm.tm_hour = number(17, 2);
+    tm.tm_min = number(20, 2);
+    tm.tm_sec = number(23, 2);
+    if (!valid)
+        return false;
+    t = timegm(&tm);
+    return true;
+}
+
+// Add the fields every response carries. The response is new, so the
+// fields are inserted without the lookup that set() does to replace
+// an existing value.
+template <class Body, class Fields>
+void
+add_common_headers(
+    http::response<Body, Fields> &res,
+    beast::string_view content_type)
+{
+    static char const server[] = BOOST_BEAST_VERSION_STRING;
+
+    res.insert(http::field::server, server);
+    res.insert(http::field::date, http_date());
+    if (!content_type.empty())
+        res.insert(http::field::content_type, content_type);
+}
+
+#endif
@@ -0,0 +1,115 @@
+#include "revocation_list.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+
+namespace {
+
+// FNV-1a followed by a splitmix64 finalizer. The two halves of the
+// result seed the double hashing used to derive every probe position.
+std::uint64_t
+hash_id(boost::beast::string_view id) noexcept
+{
+    std::uint64_t h = 14695981039346656037ull;
+    for(unsigned char c : id)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+} // namespace
+
+revocation_list::
+    revocation_list(std::vector<std::string> ids)
+    : ids_(std::move(ids))
+{
+    std::sort(ids_.begin(), ids_.end());
+    ids_.erase(std::unique(ids_.begin(), ids_.end()), ids_.end());
+    if(ids_.empty())
+        return;
+
+    // Round the filter up to a power of two so a probe is a mask, not a modulo
+    std::uint64_t nbits = 64;
+    while(nbits < ids_.size() * 10)
+        nbits <<= 1;
+    bits_.assign(nbits / 64, 0);
+    mask_ = nbits - 1;
+
+    for(auto const& id : ids_)
+    {
+        auto const h = hash_id(id);
+        auto const step = (h >> 32) | 1;
+        for(unsigned i = 0; i < probes; ++i)
+        {
+            auto const bit = (h + i * step) & mask_;
+            bits_[bit >> 6] |= std::uint64_t{1} << (bit & 63);
+        }
+    }
+}
+
+std::shared_ptr<revocation_list const>
+revocation_list::
+    load(std::string const& path, boost::beast::error_code& ec)
+{
+    // The stream keeps the reason it could not open the file in errno
+    errno = 0;
+    std::ifstream file(path);
+    if(! file)
+    {
+        auto const error = errno;
+        ec.assign(error != 0 ? error : ENOENT, boost::beast::system_category());
+        return nullptr;
+    }
+
+    std::vector<std::string> ids;
+    std::string line;
+    while(std::getline(file, line))
+    {
+        auto const first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#')
+            continue;
+        auto const last = line.find_last_not_of(" \t\r");
+        ids.emplace_back(line, first, last - first + 1);
+    }
+    if(file.bad())
+    {
+        ec = boost::beast::errc::make_error_code(
+            boost::beast::errc::io_error);
+        return nullptr;
+    }
+
+    ec = {};
+    return std::make_shared<revocation_list const>(std::move(ids));
+}
+
+bool
+revocation_list::
+    contains(boost::beast::string_view id) const noexcept
+{
+    if(bits_.empty())
+        return false;
+
+    auto const h = hash_id(id);
+    auto const step = (h >> 32) | 1;
+    for(unsigned i = 0; i < probes; ++i)
+    {
+        auto const bit = (h + i * step) & mask_;
+        if(! (bits_[bit >> 6] & (std::uint64_t{1} << (bit & 63))))
+            return false;
+    }
+
+    auto const it = std::lower_bound(
+        ids_.begin(), ids_.end(), id,
+        [](std::string const& lhs, boost::beast::string_view rhs)
+        {
+            return boost::beast::string_view(lhs) < rhs;
+        });
+    return it != ids_.end() && boost::beast::string_view(*it) == id;
+}
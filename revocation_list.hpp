@@ -0,0 +1,45 @@
+#ifndef IR_WEBSOCKET_SERVER_REVOCATION_LIST_HPP
+#define IR_WEBSOCKET_SERVER_REVOCATION_LIST_HPP
+
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/string.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// An immutable set of revoked token ids (the "jti" claim).
+//
+// Lookups first test a Bloom filter of roughly 10 bits per entry, so
+// an id that was never revoked is rejected after a few bit tests and
+// without allocating. Only filter hits fall through to the exact set,
+// a sorted vector which is binary searched in place.
+class revocation_list
+{
+    static constexpr unsigned probes = 7;
+
+    std::vector<std::uint64_t> bits_;
+    std::uint64_t mask_ = 0;
+    std::vector<std::string> ids_;
+
+public:
+    revocation_list() = default;
+
+    explicit revocation_list(std::vector<std::string> ids);
+
+    // Load one id per line. Blank lines and lines
+    // starting with '#' are ignored.
+    static std::shared_ptr<revocation_list const>
+    load(std::string const& path, boost::beast::error_code& ec);
+
+    bool
+    contains(boost::beast::string_view id) const noexcept;
+
+    std::size_t
+    size() const noexcept
+    {
+        return ids_.size();
+    }
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef IR_WEBSOCKET_SERVER_RING_QUEUE_HPP
+#define IR_WEBSOCKET_SERVER_RING_QUEUE_HPP
+
+#include <boost/optional.hpp>
+#include <array>
+#include <cstddef>
+#include <utility>
+
+// A fixed-capacity FIFO for one thread.
+//
+// Slots live inline in the owner, so a session's response queue costs
+// no allocations however often it fills and drains. Elements need not
+// be default constructible; a slot is constructed on push and destroyed
+// on pop. Unlike std::queue, every queued element can be reached.
+template<class T, std::size_t Capacity>
+class ring_queue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    std::array<boost::optional<T>, Capacity> slots_;
+    std::size_t head_ = 0;
+    std::size_t size_ = 0;
+
+public:
+    static constexpr std::size_t
+    capacity() noexcept
+    {
+        return Capacity;
+    }
+
+    std::size_t
+    size() const noexcept
+    {
+        return size_;
+    }
+
+    bool
+    empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    bool
+    full() const noexcept
+    {
+        return size_ == Capacity;
+    }
+
+    // The i-th element counting from the front
+    T&
+    operator[](std::size_t i) noexcept
+    {
+        return *slots_[(head_ + i) & (Capacity - 1)];
+    }
+
+    T&
+    front() noexcept
+    {
+        return *slots_[head_];
+    }
+
+    // Requires ! full()
+    void
+    push(T&& value)
+    {
+        slots_[(head_ + size_) & (Capacity - 1)].emplace(std::move(value));
+        ++size_;
+    }
+
+    // Requires ! empty()
+    void
+    pop() noexcept
+    {
+        slots_[head_].reset();
+        head_ = (head_ + 1) & (Capacity - 1);
+        --size_;
+    }
+};
+
+#endif
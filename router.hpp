@@ -0,0 +1,346 @@
+#ifndef IR_WEBSOCKET_SERVER_ROUTER_HPP
+#define IR_WEBSOCKET_SERVER_ROUTER_HPP
+
+#include "base.hpp"
+#include "body_sink.hpp"
+#include "body_source.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+class shared_state;
+
+// The parameters a route pattern captured, as views into the
+// request-target
+class route_params
+{
+public:
+    static constexpr std::size_t max_params = 8;
+
+    // The value captured by ":name" or "*name", empty if there is none
+    beast::string_view
+    get(beast::string_view name) const noexcept
+    {
+        for (std::size_t i = 0; i < size_; ++i)
+            if (params_[i].first == name)
+                return params_[i].second;
+        return {};
+    }
+
+private:
+    template <class>
+    friend class router;
+
+    std::array<std::pair<beast::string_view, beast::string_view>, max_params> params_;
+    std::size_t size_ = 0;
+};
+
+// How a route takes the request body. By default it is read into
+// memory, up to `limit` bytes. A route which sets `open` gets it as a
+// stream instead: once the header is read, open returns the sink the
+// body is written to a piece at a time, so memory stays bounded by
+// the session's chunk size whatever the limit. If open fails, the
+// body is not read and the handler sees the error. A route which sets
+// `authorize` only has the body read from requests with a valid
+// access token, the handler sees errc::permission_denied otherwise.
+struct body_policy
+{
+    std::uint64_t limit = 10000;
+    std::function<std::shared_ptr<body_sink>(
+        shared_state &, route_params const &, beast::error_code &)> open;
+    bool authorize = false;
+};
+
+// How the session reads the body of one request, decided by its
+// route once the header is in
+struct body_plan
+{
+    std::uint64_t limit = 10000;
+    std::shared_ptr<body_sink> sink;    // set for routes which stream
+    beast::error_code ec;               // the body could not be received
+    std::string refused;                // why the access token was not accepted
+};
+
+// What a route handler gets: the request, the server state and the
+// parameters its pattern captured
+template <class Request>
+class route_context
+{
+public:
+    route_context(
+        shared_state &state,
+        Request &req,
+        beast::string_view path,
+        body_plan body = {}) noexcept
+        : state_(state), req_(req), path_(path), body_(std::move(body))
+    {
+    }
+
+    shared_state &
+    state() const noexcept
+    {
+        return state_;
+    }
+
+    Request &
+    request() const noexcept
+    {
+        return req_;
+    }
+
+    // The request-target without its query
+    beast::string_view
+    path() const noexcept
+    {
+        return path_;
+    }
+
+    route_params &
+    params() noexcept
+    {
+        return params_;
+    }
+
+    beast::string_view
+    param(beast::string_view name) const noexcept
+    {
+        return params_.get(name);
+    }
+
+    // The sink a streamed body was written to
+    body_sink *
+    sink() const noexcept
+    {
+        return body_.sink.get();
+    }
+
+    // Why a streamed body could not be received
+    beast::error_code
+    body_error() const noexcept
+    {
+        return body_.ec;
+    }
+
+    // Why the access token was not accepted, when body_error()
+    // is errc::permission_denied
+    std::string const &
+    access_refused() const noexcept
+    {
+        return body_.refused;
+    }
+
+private:
+    shared_state &state_;
+    Request &req_;
+    beast::string_view path_;
+    route_params params_;
+    body_plan body_;
+};
+
+// Maps a method and path to a handler.
+//
+// Patterns are made of literal text, ":name" for one path segment
+// and a trailing "*name" for the rest of the path, such as
+// "/api/users/:id" or "/static/*path". They are kept in a radix tree
+// built once at startup, so a lookup walks the path a character at a
+// time however many routes there are, and allocates nothing. Literal
+// text is preferred over a parameter, and a parameter over "*", among
+// the patterns routed for the request's method.
+template <class Request>
+class router
+{
+public:
+    using handler = std::function<response_message(route_context<Request> &)>;
+
+    struct route
+    {
+        handler handle;
+        body_policy body;
+    };
+
+    // Add a route. Throws std::logic_error for a malformed pattern
+    // or one which conflicts with an existing route.
+    void
+    add(http::verb method, beast::string_view pattern, handler h, body_policy body = {})
+    {
+        if (pattern.empty() || pattern.front() != '/')
+            throw std::logic_error("route must start with '/'");
+
+        auto n = &root_;
+        while (!pattern.empty())
+        {
+            if (pattern.front() == ':' || pattern.front() == '*')
+            {
+                auto const wildcard = pattern.front() == '*';
+                auto const end = wildcard ? pattern.size() : std::min(pattern.find('/'), pattern.size());
+                auto const name = pattern.substr(1, end - 1);
+                if (name.empty())
+                    throw std::logic_error("route parameter needs a name");
+                auto &child = wildcard ? n->wildcard : n->param;
+                if (!child)
+                {
+                    child = std::make_unique<node>();
+                    child->name = std::string(name);
+                }
+                else if (child->name != name)
+                    throw std::logic_error("conflicting route parameter names");
+                n = child.get();
+                pattern.remove_prefix(end);
+                continue;
+            }
+
+            auto const end = std::min(pattern.find_first_of(":*"), pattern.size());
+            if (end < pattern.size() && pattern[end - 1] != '/')
+                throw std::logic_error("route parameter must follow '/'");
+            n = insert_literal(*n, pattern.substr(0, end));
+            pattern.remove_prefix(end);
+        }
+
+        for (auto const &entry : n->routes)
+            if (entry.first == method)
+                throw std::logic_error("duplicate route");
+        n->routes.emplace_back(method, route{std::move(h), std::move(body)});
+    }
+
+    // Find the route for a method and path, filling `params` with
+    // what its pattern captured. Returns null if there is none, and
+    // if the path is routed for other methods appends them to
+    // `allow`, for the Allow field of a 405.
+    route const *
+    find(
+        http::verb method,
+        beast::string_view path,
+        route_params &params,
+        std::string &allow) const
+    {
+        params.size_ = 0;
+        std::uint64_t others = 0;
+        if (auto const r = match(root_, path, method, params, others))
+            return r;
+        for (unsigned v = 0; v < 64; ++v)
+        {
+            if ((others & (std::uint64_t(1) << v)) == 0)
+                continue;
+            if (!allow.empty())
+                allow.append(", ");
+            auto const name = http::to_string(static_cast<http::verb>(v));
+            allow.append(name.data(), name.size());
+        }
+        return nullptr;
+    }
+
+private:
+    struct node
+    {
+        std::string prefix;     // literal text
+        std::string name;       // of a parameter
+        std::vector<std::unique_ptr<node>> children;    // distinct first characters
+        std::unique_ptr<node> param;
+        std::unique_ptr<node> wildcard;
+        std::vector<std::pair<http::verb, route>> routes;
+    };
+
+    node root_;
+
+    static node *
+    insert_literal(node &parent, beast::string_view text)
+    {
+        auto n = &parent;
+        while (!text.empty())
+        {
+            auto const it = std::find_if(n->children.begin(), n->children.end(),
+                [&text](std::unique_ptr<node> const &c) { return c->prefix.front() == text.front(); });
+            if (it == n->children.end())
+            {
+                n->children.push_back(std::make_unique<node>());
+                n->children.back()->prefix = std::string(text);
+                return n->children.back().get();
+            }
+
+            // Split the child where the texts part
+            auto &child = *it;
+            std::size_t common = 0;
+            while (common < child->prefix.size() && common < text.size() &&
+                child->prefix[common] == text[common])
+                ++common;
+            if (common < child->prefix.size())
+            {
+                auto split = std::make_unique<node>();
+                split->prefix = child->prefix.substr(0, common);
+                child->prefix.erase(0, common);
+                split->children.push_back(std::move(child));
+                child = std::move(split);
+            }
+            n = child.get();
+            text.remove_prefix(common);
+        }
+        return n;
+    }
+
+    // The route of a matching node for the method. If it has none,
+    // its methods are added to `others` as bits of their http::verb.
+    static route const *
+    route_for(node const &n, http::verb method, std::uint64_t &others)
+    {
+        for (auto const &entry : n.routes)
+            if (entry.first == method)
+                return &entry.second;
+        for (auto const &entry : n.routes)
+            others |= std::uint64_t(1) << (static_cast<unsigned>(entry.first) % 64);
+        return nullptr;
+    }
+
+    // Literal children first, then a parameter, then the rest of the
+    // path. A branch which fails further down, or whose pattern is not
+    // routed for the method, falls back to the next.
+    static route const *
+    match(
+        node const &n,
+        beast::string_view path,
+        http::verb method,
+        route_params &params,
+        std::uint64_t &others)
+    {
+        if (path.empty())
+            if (auto const r = route_for(n, method, others))
+                return r;
+
+        for (auto const &child : n.children)
+        {
+            if (path.empty() || child->prefix.front() != path.front())
+                continue;
+            if (path.starts_with(child->prefix))
+                if (auto const r = match(*child, path.substr(child->prefix.size()), method, params, others))
+                    return r;
+            break;
+        }
+
+        if (n.param && !path.empty() && path.front() != '/' && params.size_ < params.max_params)
+        {
+            auto const end = std::min(path.find('/'), path.size());
+            params.params_[params.size_++] = {n.param->name, path.substr(0, end)};
+            if (auto const r = match(*n.param, path.substr(end), method, params, others))
+                return r;
+            --params.size_;
+        }
+
+        if (n.wildcard && params.size_ < params.max_params)
+        {
+            if (auto const r = route_for(*n.wildcard, method, others))
+            {
+                params.params_[params.size_++] = {n.wildcard->name, path};
+                return r;
+            }
+        }
+        return nullptr;
+    }
+};
+
+#endif
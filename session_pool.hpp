@@ -0,0 +1,159 @@
+#ifndef IR_WEBSOCKET_SERVER_SESSION_POOL_HPP
+#define IR_WEBSOCKET_SERVER_SESSION_POOL_HPP
+
+#include <boost/beast/core/flat_buffer.hpp>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace detail {
+
+// Per-thread free lists of blocks in power of two size classes.
+//
+// A block freed on another thread than the one that allocated it
+// simply joins that thread's list. Lists are capped so that a burst
+// of connections does not pin its peak memory forever.
+class block_cache
+{
+    static constexpr std::size_t min_shift = 6;     // 64 bytes
+    static constexpr std::size_t max_shift = 16;    // 64 KiB
+    static constexpr std::size_t max_free = 256;    // blocks per class
+
+    std::array<std::vector<void*>, max_shift - min_shift + 1> free_;
+
+    static std::size_t
+    size_class(std::size_t size) noexcept
+    {
+        std::size_t shift = min_shift;
+        while((std::size_t{1} << shift) < size)
+            ++shift;
+        return shift - min_shift;
+    }
+
+public:
+    block_cache() = default;
+    block_cache(block_cache const&) = delete;
+    block_cache& operator=(block_cache const&) = delete;
+
+    ~block_cache()
+    {
+        for(auto& list : free_)
+            for(auto block : list)
+                ::operator delete(block);
+    }
+
+    void*
+    allocate(std::size_t size)
+    {
+        if(size > (std::size_t{1} << max_shift))
+            return ::operator new(size);
+        auto const cls = size_class(size);
+        auto& list = free_[cls];
+        if(list.empty())
+            return ::operator new(std::size_t{1} << (cls + min_shift));
+        auto const block = list.back();
+        list.pop_back();
+        return block;
+    }
+
+    void
+    deallocate(void* block, std::size_t size) noexcept
+    {
+        if(size > (std::size_t{1} << max_shift))
+            return ::operator delete(block);
+        auto& list = free_[size_class(size)];
+        if(list.size() >= max_free)
+            return ::operator delete(block);
+        if(list.capacity() == 0)
+        {
+            // Reserve once so that pushing never throws afterwards
+            try
+            {
+                list.reserve(max_free);
+            }
+            catch(std::bad_alloc const&)
+            {
+                return ::operator delete(block);
+            }
+        }
+        list.push_back(block);
+    }
+};
+
+inline block_cache&
+local_block_cache()
+{
+    thread_local block_cache cache;
+    return cache;
+}
+
+} // detail
+
+// A stateless allocator drawing from the calling thread's block cache.
+// Sessions are created with std::allocate_shared using this allocator,
+// so the object and its control block come from a recycled block, and
+// their buffers use it too.
+template<class T>
+class pool_allocator
+{
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    pool_allocator() = default;
+
+    template<class U>
+    pool_allocator(pool_allocator<U> const&) noexcept
+    {
+    }
+
+    T*
+    allocate(std::size_t n)
+    {
+        if(n > static_cast<std::size_t>(-1) / sizeof(T))
+            throw std::bad_array_new_length();
+        return static_cast<T*>(detail::local_block_cache().allocate(n * sizeof(T)));
+    }
+
+    void
+    deallocate(T* p, std::size_t n) noexcept
+    {
+        detail::local_block_cache().deallocate(p, n * sizeof(T));
+    }
+
+    template<class U>
+    friend bool
+    operator==(pool_allocator const&, pool_allocator<U> const&) noexcept
+    {
+        return true;
+    }
+
+    template<class U>
+    friend bool
+    operator!=(pool_allocator const&, pool_allocator<U> const&) noexcept
+    {
+        return false;
+    }
+};
+
+// Create a session whose storage is recycled across connections
+template<class Session, class... Args>
+std::shared_ptr<Session>
+make_pooled_session(Args&&... args)
+{
+    return std::allocate_shared<Session>(
+        pool_allocator<Session>(), std::forward<Args>(args)...);
+}
+
+// The buffer handed from the detector to the HTTP session,
+// and owned by each WebSocket session
+using session_buffer = boost::beast::basic_flat_buffer<pool_allocator<char>>;
+
+// Initial capacity of a session buffer, enough for typical request headers
+constexpr std::size_t session_buffer_size = 4096;
+
+#endif
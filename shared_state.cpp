@@ -1,4 +1,5 @@
 #include "shared_state.hpp"
+#include "logging.hpp"
 #include "websocket_session.hpp"
 
 shared_state::
@@ -7,54 +8,28 @@ shared_state::
 {
 }
 
-// void shared_state::
-//     connect(const std::string &connection_id, WebsocketSession *session)
-// {
-//     sessions_[connection_id] = session;
-//     send(connection_id, "you connected as :" + connection_id);
-// }
-
-// void shared_state::
-//     disconnect(const std::string &connection_id)
-// {
-//     if (connection_id != "")
-//     {
-//         sessions_.erase(connection_id);
-//         boost::beast::flat_buffer buff;
-//         std::string myString = "a client disconnected :" + connection_id;
-//         boost::beast::ostream(buff) << myString;
-//         broadcast(beast::buffers_to_string(buff.data()));
-//     }
-// }
+bool shared_state::
+    set_revocation_file(std::string path)
+{
+    revocation_file_ = std::move(path);
+    return reload_revocations();
+}
 
-// void shared_state::
-//     send(const std::string &connection_id, const std::string &message)
-// {
-//     auto const session = get(connection_id);
-//     if (session != nullptr)
-//     {
-//         auto const ss = std::make_shared<std::string const>(std::move(message));
-//         session->send(ss);
-//     }
-// }
+bool shared_state::
+    reload_revocations()
+{
+    if (revocation_file_.empty())
+        return false;
 
-// void shared_state::
-//     broadcast(const std::string &message)
-// {
-//     for (const auto &entry : sessions_)
-//     {
-//         WebsocketSession *session = entry.second;
-//         if (session != nullptr)
-//         {
-//             auto const ss = std::make_shared<std::string const>(std::move(message));
-//             session->send(ss);
-//         }
-//     }
-// }
+    beast::error_code ec;
+    auto revoked = revocation_list::load(revocation_file_, ec);
+    if (ec)
+    {
+        FLEX_LOG(error, "revocations: %s: %s", revocation_file_.c_str(), ec.message().c_str());
+        return false;
+    }
 
-// WebsocketSession *shared_state::
-//     get(const std::string &connection_id)
-// {
-//     auto it = sessions_.find(connection_id);
-//     return (it != sessions_.end()) ? it->second : nullptr;
-// }
+    FLEX_LOG(info, "revocations: loaded %zu token ids", revoked->size());
+    std::atomic_store(&revoked_, std::move(revoked));
+    return true;
+}
@@ -1,22 +1,41 @@
 #ifndef IR_WEBSOCKET_SERVER_SHARED_STATE_HPP
 #define IR_WEBSOCKET_SERVER_SHARED_STATE_HPP
 
+#include "broadcast.hpp"
+#include "compression.hpp"
+#include "file_cache.hpp"
+#include "mapped_file.hpp"
+#include "revocation_list.hpp"
+#include <boost/asio/thread_pool.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
-#include <unordered_map>
-
-// Forward declaration
-class WebsocketSession;
 
 // Represents the shared server state
 class shared_state
 {
     std::string doc_root_;
+    file_cache files_;
+    compression_cache compressed_;
+    mapping_cache mappings_;
+
+    // Reads files which are not in the page cache, see file_source
+    boost::asio::thread_pool file_pool_{4};
+    std::string revocation_file_;
+
+    // Where PUT /uploads/ writes, empty if uploads are off
+    std::string upload_dir_;
 
-    // This simple method of tracking
-    // sessions only works with an implicit
-    // strand (i.e. a single-threaded server)
-    // std::unordered_map<std::string, WebsocketSession *> sessions_;
+    // Swapped as a whole on reload, always accessed
+    // through std::atomic_load and std::atomic_store
+    std::shared_ptr<revocation_list const> revoked_;
+
+    // Per-connection pipelining limits, set before the server starts
+    std::size_t pipeline_depth_ = 16;
+    std::uint64_t pipeline_bytes_ = 1024 * 1024;
+
+    broadcast_hub broadcasts_;
 
 public:
     explicit shared_state(std::string doc_root);
@@ -27,11 +46,96 @@ public:
         return doc_root_;
     }
 
-    // void connect(const std::string &connection_id,WebsocketSession* session);
-    // void disconnect(const std::string &connection_id);
-    // void send(const std::string &connection_id,const std::string &message);
-    // void broadcast(const std::string &message);
-    // WebsocketSession* get(const std::string &connection_id);
+    // Metadata of the files under doc_root
+    file_cache &
+    files() noexcept
+    {
+        return files_;
+    }
+
+    // Compressed copies of the files under doc_root
+    compression_cache &
+    compressed() noexcept
+    {
+        return compressed_;
+    }
+
+    // Mappings of mid-sized files under doc_root
+    mapping_cache &
+    mappings() noexcept
+    {
+        return mappings_;
+    }
+
+    // Threads for blocking file reads
+    boost::asio::thread_pool &
+    file_pool() noexcept
+    {
+        return file_pool_;
+    }
+
+    // The directory uploaded files are written to, empty if uploads
+    // are turned off
+    std::string const &
+    upload_dir() const noexcept
+    {
+        return upload_dir_;
+    }
+
+    void
+    set_upload_dir(std::string dir)
+    {
+        upload_dir_ = std::move(dir);
+    }
+
+    // The most responses a connection may have queued. Sessions start
+    // lower and grow towards it while the client keeps up.
+    std::size_t
+    pipeline_depth() const noexcept
+    {
+        return pipeline_depth_;
+    }
+
+    void
+    set_pipeline_depth(std::size_t depth) noexcept
+    {
+        pipeline_depth_ = depth;
+    }
+
+    // Reading stops while a connection's queued responses exceed this
+    std::uint64_t
+    pipeline_bytes() const noexcept
+    {
+        return pipeline_bytes_;
+    }
+
+    void
+    set_pipeline_bytes(std::uint64_t bytes) noexcept
+    {
+        pipeline_bytes_ = bytes;
+    }
+
+    // Set the file of revoked token ids and load it
+    bool set_revocation_file(std::string path);
+
+    // Reload the revoked token ids, keeping the
+    // previous set if the file cannot be read
+    bool reload_revocations();
+
+    // Returns true if the token id has been revoked
+    bool
+    is_revoked(boost::beast::string_view jti) const noexcept
+    {
+        auto const revoked = std::atomic_load(&revoked_);
+        return revoked && revoked->contains(jti);
+    }
+
+    // Messages for every WebSocket session and event stream
+    broadcast_hub &
+    broadcasts() noexcept
+    {
+        return broadcasts_;
+    }
 };
 
 #endif
@@ -0,0 +1,54 @@
+#ifndef IR_WEBSOCKET_SERVER_SHARED_STRING_BODY_HPP
+#define IR_WEBSOCKET_SERVER_SHARED_STRING_BODY_HPP
+
+#include "base.hpp"
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+// A body holding a reference to an immutable string, so that a cached
+// or pre-serialized payload can be sent on many connections at once
+// without a copy per response.
+struct shared_string_body
+{
+    using value_type = std::shared_ptr<std::string const>;
+
+    static std::uint64_t
+    size(value_type const &body) noexcept
+    {
+        return body ? body->size() : 0;
+    }
+
+    class writer
+    {
+        value_type const &body_;
+
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, class Fields>
+        writer(http::header<isRequest, Fields> const &, value_type const &body)
+            : body_(body)
+        {
+        }
+
+        void
+        init(beast::error_code &ec)
+        {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>>
+        get(beast::error_code &ec)
+        {
+            ec = {};
+            if (!body_)
+                return boost::none;
+            return {{net::buffer(*body_), false}};
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef IR_WEBSOCKET_SERVER_SPSC_RING_HPP
+#define IR_WEBSOCKET_SERVER_SPSC_RING_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// A bounded single-producer single-consumer ring of fixed-size records.
+//
+// The producer fills a slot in place and publishes it with a release
+// store; it never blocks, a full ring simply refuses the record. Each
+// side caches the other's index so that the shared cache lines are
+// only touched when the cached view runs out.
+template<class T, std::size_t Capacity>
+class spsc_ring
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    // Written by the producer
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    std::size_t cached_head_ = 0;
+
+    // Written by the consumer
+    alignas(64) std::atomic<std::size_t> head_{0};
+    std::size_t cached_tail_ = 0;
+
+    alignas(64) std::array<T, Capacity> slots_;
+
+public:
+    // Producer side. Calls fill(T&) on a free slot and publishes it,
+    // or returns false without calling fill if the ring is full.
+    template<class Fill>
+    bool
+    try_push(Fill&& fill)
+    {
+        auto const tail = tail_.load(std::memory_order_relaxed);
+        if(tail - cached_head_ == Capacity)
+        {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if(tail - cached_head_ == Capacity)
+                return false;
+        }
+        fill(slots_[tail & (Capacity - 1)]);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Calls f(T const&) on up to `limit` records
+    // in order and returns how many were consumed.
+    template<class F>
+    std::size_t
+    drain(F&& f, std::size_t limit = Capacity)
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        if(head == cached_tail_)
+        {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if(head == cached_tail_)
+                return 0;
+        }
+        std::size_t n = 0;
+        for(; head != cached_tail_ && n < limit; ++head, ++n)
+            f(slots_[head & (Capacity - 1)]);
+        head_.store(head, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side
+    bool
+    empty() const noexcept
+    {
+        return head_.load(std::memory_order_relaxed) ==
+            tail_.load(std::memory_order_acquire);
+    }
+};
+
+#endif
@@ -1,6 +1,45 @@
 #include "base.hpp"
-#include "include/jwt-cpp/traits/boost-json/defaults.h"
+#include "access_token.hpp"
+#include "broadcast.hpp"
+#include "handler_allocator.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "response_headers.hpp"
+#include "session_pool.hpp"
 #include "shared_state.hpp"
+#include <deque>
+
+// Hands broadcasts to a WebSocket session on its own executor. The
+// session owns its subscriber, so the hub loses track of it as soon as
+// the session is gone.
+template <class WebsocketSession>
+class websocket_subscriber : public broadcast_subscriber
+{
+    std::weak_ptr<WebsocketSession> session_;
+
+public:
+    explicit websocket_subscriber(std::weak_ptr<WebsocketSession> session)
+        : session_(std::move(session))
+    {
+    }
+
+    void
+    deliver(broadcast_event const &event) override
+    {
+        if (!event.text)
+            return;
+        auto session = session_.lock();
+        if (!session)
+            return;
+        auto &ws = session->ws();
+        net::post(
+            ws.get_executor(),
+            [session = std::move(session), text = event.text]
+            {
+                session->send(text);
+            });
+    }
+};
 
 template <class WebsocketSession>
 class WebsocketSessionManager
@@ -13,28 +52,56 @@ class WebsocketSessionManager
         return static_cast<WebsocketSession &>(*this);
     }
 
-    beast::flat_buffer buffer_;
+    // A message waiting to be written. The echo of the last read
+    // has no text of its own, it is written from buffer_, and reading
+    // resumes once it is out.
+    struct outgoing
+    {
+        std::shared_ptr<std::string const> text;
+        bool binary = false;
+    };
+
+    session_buffer buffer_;
     std::shared_ptr<shared_state> state_;
-    std::vector<std::shared_ptr<std::string const>> queue_;
+    std::deque<outgoing> queue_;
+    std::shared_ptr<broadcast_subscriber> subscriber_;
     std::string connection_id;
 
-    void send(std::shared_ptr<std::string const> const &ss)
+    // Recycled by the read loop and by the write queue, which writes
+    // one message at a time
+    handler_memory read_memory_;
+    handler_memory write_memory_;
+
+    std::chrono::steady_clock::time_point upgrade_started_;
+    std::chrono::steady_clock::time_point message_received_;
+
+    void
+    push(outgoing message)
     {
-        // Always add to queue
-        queue_.push_back(ss);
+        queue_.push_back(std::move(message));
 
         // Are we already writing?
         if (queue_.size() > 1)
             return;
 
-        // We are not currently writing, so send this immediately
+        do_write();
+    }
+
+    void
+    do_write()
+    {
+        auto const &front = queue_.front();
+        websocketSession().ws().text(!front.binary);
+        auto const buffer = front.text
+            ? net::const_buffer(net::buffer(*front.text))
+            : net::const_buffer(buffer_.data());
         websocketSession().ws().async_write(
-            net::buffer(*queue_.front()),
-            [sp = websocketSession().shared_from_this()](
-                beast::error_code ec, std::size_t bytes)
-            {
-                sp->on_write(ec, bytes);
-            });
+            buffer,
+            make_custom_alloc_handler(
+                write_memory_,
+                beast::bind_front_handler(
+                    &WebsocketSessionManager::on_write,
+                    websocketSession().shared_from_this())));
     }
 
     void close_with_401(http::request<http::string_body> &req, const std::string &error_message)
@@ -48,6 +115,7 @@ class WebsocketSessionManager
         // Send an HTTP response with a 401 status code and an error message
         http::response<http::string_body> res{http::status::unauthorized, req.version()};
         res.set(http::field::server, "ir-websocket-server");
+        res.set(http::field::date, http_date());
         res.set(http::field::content_type, "application/json");
         res.body() = "Unauthorized: " + error_message;
         res.prepare_payload();
@@ -60,29 +128,6 @@ class WebsocketSessionManager
                               beast::error_code ec, std::size_t bytes) {});
     }
 
-    std::string url_decode(const std::string &input)
-    {
-        std::string result;
-        for (std::size_t i = 0; i < input.size(); ++i)
-        {
-            if (input[i] == '%' && i + 2 < input.size() &&
-                std::isxdigit(input[i + 1]) && std::isxdigit(input[i + 2]))
-            {
-                result += static_cast<char>(std::stoi(input.substr(i + 1, 2), 0, 16));
-                i += 2;
-            }
-            else if (input[i] == '+')
-            {
-                result += ' ';
-            }
-            else
-            {
-                result += input[i];
-            }
-        }
-        return result;
-    }
-
     std::string generate_random_string(int length)
     {
         const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
@@ -106,6 +151,8 @@ class WebsocketSessionManager
     void
     do_accept(http::request<Body, http::basic_fields<Allocator>> req)
     {
+        upgrade_started_ = std::chrono::steady_clock::now();
+
         // Set suggested timeout settings for the websocket
         websocketSession().ws().set_option(
             websocket::stream_base::timeout::suggested(
@@ -117,47 +164,37 @@ class WebsocketSessionManager
                 [](websocket::response_type &res)
                 {
                     res.set(http::field::server,
-                            std::string(BOOST_BEAST_VERSION_STRING) +
-                                " advanced-server-flex");
+                            BOOST_BEAST_VERSION_STRING " advanced-server-flex");
+                    res.set(http::field::date, http_date());
                 }));
 
         // Accept the websocket handshake
 
-        std::string token;
-        if (req.target().find("?token=") != std::string::npos)
+        auto const token = request_token(req.target(), req[http::field::authorization]);
+        std::string error;
+        if (!verify_access_token(*websocketSession().state(), token, error))
         {
-            // Extract token from URI
-            token = req.target().substr(req.target().find("?token=") + 7);
-            token = url_decode(token);
+            FLEX_LOG_LIMITED(info, "websocket token rejected: %s", error.c_str());
+            return close_with_401(req, error);
         }
-        try
-        {
-            const auto decoded_token = jwt::decode<jwt::traits::boost_json>(token);
-            const auto verify = jwt::verify<jwt::traits::boost_json>().allow_algorithm(jwt::algorithm::hs256{"secret"}).with_issuer("auth0").with_audience("aud0");
-            verify.verify(decoded_token);
-            std::cout << "succeed!" << '\n';
 
-            websocketSession().ws().async_accept(
-                req,
-                beast::bind_front_handler(
-                    &WebsocketSessionManager::on_accept,
-                    websocketSession().shared_from_this()));
-        }
-        catch (const std::exception &e)
-        {
-            std::cerr << "token error :" << e.what() << '\n';
-            close_with_401(req, e.what());
-        }
+        FLEX_LOG(debug, "websocket token verified");
+
+        websocketSession().ws().async_accept(
+            req,
+            beast::bind_front_handler(
+                &WebsocketSessionManager::on_accept,
+                websocketSession().shared_from_this()));
     }
 
 private:
     void
     fail(beast::error_code ec, char const *what)
     {
-        std::cerr << what << ": " << ec.message() << "\n";
-
         if (ec == net::ssl::error::stream_truncated)
             return;
+
+        FLEX_LOG_LIMITED(warn, "websocket %s: %s", what, ec.message().c_str());
     }
 
     void
@@ -166,6 +203,13 @@ private:
         if (ec)
             return fail(ec, "accept");
 
+        metrics::record_since(metrics::stage::websocket_upgrade, upgrade_started_);
+
+        // Receive broadcasts from now on
+        subscriber_ = std::make_shared<websocket_subscriber<WebsocketSession>>(
+            websocketSession().shared_from_this());
+        websocketSession().state()->broadcasts().subscribe(subscriber_);
+
         // Read a message
         do_read();
     }
@@ -179,9 +223,11 @@ private:
         // Read a message into our buffer
         websocketSession().ws().async_read(
             buffer_,
-            beast::bind_front_handler(
-                &WebsocketSessionManager::on_read,
-                websocketSession().shared_from_this()));
+            make_custom_alloc_handler(
+                read_memory_,
+                beast::bind_front_handler(
+                    &WebsocketSessionManager::on_read,
+                    websocketSession().shared_from_this())));
     }
 
     void
@@ -189,7 +235,11 @@ private:
         beast::error_code ec,
         std::size_t bytes_transferred)
     {
-        boost::ignore_unused(bytes_transferred);
+        metrics::add(metrics::counter::bytes_received, bytes_transferred);
+
+        // No more broadcasts once the connection is going away
+        if (ec)
+            subscriber_.reset();
 
         // This indicates that the WebsocketSessionManager was closed
         if (ec == websocket::error::closed)
@@ -198,13 +248,10 @@ private:
         if (ec)
             return fail(ec, "read");
 
-        // Echo the message
-        websocketSession().ws().text(websocketSession().ws().got_text());
-        websocketSession().ws().async_write(
-            buffer_.data(),
-            beast::bind_front_handler(
-                &WebsocketSessionManager::on_write,
-                websocketSession().shared_from_this()));
+        message_received_ = std::chrono::steady_clock::now();
+
+        // Echo the message, after any broadcasts already queued
+        push({nullptr, !websocketSession().ws().got_text()});
     }
 
     void
@@ -212,16 +259,26 @@ private:
         beast::error_code ec,
         std::size_t bytes_transferred)
     {
-        boost::ignore_unused(bytes_transferred);
+        metrics::add(metrics::counter::bytes_sent, bytes_transferred);
 
         if (ec)
             return fail(ec, "write");
 
-        // Clear the buffer
-        buffer_.consume(buffer_.size());
+        auto const echo = !queue_.front().text;
+        queue_.pop_front();
+        if (echo)
+        {
+            metrics::record_since(metrics::stage::websocket_message, message_received_);
 
-        // Do another read
-        do_read();
+            // Clear the buffer
+            buffer_.consume(buffer_.size());
+
+            // Do another read
+            do_read();
+        }
+
+        if (!queue_.empty())
+            do_write();
     }
     void
     on_close(beast::error_code ec)
@@ -232,6 +289,30 @@ private:
     }
 
 public:
+    // Send a text message, called on the session's executor. A client
+    // which falls too far behind misses messages rather than letting
+    // them pile up.
+    void
+    send(std::shared_ptr<std::string const> text)
+    {
+        if (queue_.size() >= broadcast_hub::max_backlog)
+        {
+            metrics::add(metrics::counter::broadcast_dropped);
+            return;
+        }
+        push({std::move(text), false});
+    }
+
+    WebsocketSessionManager()
+    {
+        metrics::add(metrics::gauge::websocket_sessions, 1);
+    }
+
+    ~WebsocketSessionManager()
+    {
+        metrics::add(metrics::gauge::websocket_sessions, -1);
+    }
+
     // Start the asynchronous operation
     template <class Body, class Allocator>
     void
@@ -309,7 +390,7 @@ void MakeWebsocketSession(
     http::request<Body, http::basic_fields<Allocator>> req,
     std::shared_ptr<shared_state> state)
 {
-    std::make_shared<PlainWebsocketSessionManager>(
+    make_pooled_session<PlainWebsocketSessionManager>(
         std::move(stream), std::move(state))
         ->run(std::move(req));
 }
@@ -320,7 +401,7 @@ void MakeWebsocketSession(
     http::request<Body, http::basic_fields<Allocator>> req,
     std::shared_ptr<shared_state> state)
 {
-    std::make_shared<SSLWebsocketSessionManager>(
+    make_pooled_session<SSLWebsocketSessionManager>(
         std::move(stream), std::move(state))
         ->run(std::move(req));
 }
\ No newline at end of file